@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2014 Miguel Sarabia
+ * Imperial College London
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef ARENA_IMPL_H
+#define ARENA_IMPL_H
+
+#include "Common.h"
+#include <new>
+
+namespace sartparser
+{
+namespace impl
+{
+
+// Bump allocator for objects of a single type. Objects are carved out of
+// blocks of growing size and are all destroyed together when the arena is
+// cleared (or destroyed). Objects released with Free() are recycled by the
+// next call to New(), and so are all the blocks after Recycle().
+template<typename T>
+class Arena
+{
+public:
+    Arena();
+    ~Arena();
+
+    // Returns a default constructed object owned by the arena
+    T* New();
+
+    // Destroys pItem, its storage is reused by the next New()
+    void Free(T* pItem);
+
+    // Sizes the first block for count objects (no effect once the arena
+    // has allocated anything)
+    void Reserve(size_t count);
+
+    // Destroys every object and releases all the memory
+    void Clear();
+
+    // Destroys every object but keeps the blocks for the next objects
+    void Recycle();
+
+private:
+    //Arenas cannot be copied  (for safety)
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+
+    struct Block
+    {
+        T* data;
+        size_t capacity;
+        size_t used;
+    };
+
+    const static size_t FIRST_BLOCK = 64;
+    const static size_t MAX_BLOCK = 4096;
+
+    // Destroys the objects below the used mark of every block
+    void DestroyAll();
+
+    std::vector<Block> blocks_;
+    // Block objects are carved from, the ones after it are empty
+    size_t current_;
+    std::vector<T*> free_;
+};
+
+template<typename T>
+inline Arena<T>::Arena()
+    : blocks_()
+    , current_(0)
+    , free_()
+{
+}
+
+template<typename T>
+inline Arena<T>::~Arena()
+{
+    Clear();
+}
+
+template<typename T>
+inline T* Arena<T>::New()
+{
+    if ( !free_.empty() )
+    {
+        T* pItem = free_.back();
+        free_.pop_back();
+        return new (pItem) T();
+    }
+
+    while ( current_ < blocks_.size() &&
+            blocks_[current_].used == blocks_[current_].capacity )
+        ++current_;
+
+    if ( current_ == blocks_.size() )
+    {
+        Block block;
+        // Blocks double in size up to MAX_BLOCK objects
+        size_t capacity = blocks_.empty() ? 0 : 2 * blocks_.back().capacity;
+        block.capacity = (capacity == 0) ? FIRST_BLOCK :
+                         (capacity > MAX_BLOCK) ? MAX_BLOCK : capacity;
+        block.data = static_cast<T*>( ::operator new(block.capacity * sizeof(T)) );
+        block.used = 0;
+        blocks_.push_back(block);
+    }
+
+    Block& block = blocks_[current_];
+    T* pItem = new (block.data + block.used) T();
+    ++block.used;
+    return pItem;
+}
+
+template<typename T>
+inline void Arena<T>::Free(T* pItem)
+{
+    pItem->~T();
+    free_.push_back(pItem);
+}
+
+template<typename T>
+inline void Arena<T>::Reserve(size_t count)
+{
+    if ( !blocks_.empty() || count == 0 )
+        return;
+
+    Block block;
+    block.capacity = count;
+    block.data = static_cast<T*>( ::operator new(block.capacity * sizeof(T)) );
+    block.used = 0;
+    blocks_.push_back(block);
+}
+
+template<typename T>
+inline void Arena<T>::Clear()
+{
+    DestroyAll();
+
+    typedef typename std::vector<Block>::iterator Iterator;
+    for (Iterator it = blocks_.begin(); it != blocks_.end(); ++it)
+        ::operator delete(it->data);
+    blocks_.clear();
+}
+
+template<typename T>
+inline void Arena<T>::Recycle()
+{
+    DestroyAll();
+}
+
+template<typename T>
+inline void Arena<T>::DestroyAll()
+{
+    // Every slot below a block's used mark has to hold a live object, so
+    // bring the free ones back before destroying them all
+    typedef typename std::vector<T*>::iterator FreeIterator;
+    for (FreeIterator it = free_.begin(); it != free_.end(); ++it)
+        new (*it) T();
+    free_.clear();
+
+    typedef typename std::vector<Block>::iterator Iterator;
+    for (Iterator it = blocks_.begin(); it != blocks_.end(); ++it)
+    {
+        for (size_t i = 0; i < it->used; ++i)
+            it->data[i].~T();
+        it->used = 0;
+    }
+    current_ = 0;
+}
+
+}// end of impl namespace
+}// end of sartparser namespace
+
+#endif // ARENA_IMPL_H
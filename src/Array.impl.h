@@ -51,6 +51,7 @@ public:
     Status AddAt(size_t nIndex, T* pItem);
     Status Delete(size_t nIndex);
     T* Remove(size_t nIndex);
+    void Clear();
     T* Get(size_t nIndex);
     const T* Get(size_t nIndex) const;
     size_t GetCount() const;
@@ -135,6 +136,18 @@ inline T* Array<T>::Remove(size_t nIndex)
     return result;
 }
 
+template<typename T>
+inline void Array<T>::Clear()
+{
+    typedef typename std::vector<T*>::iterator Iterator;
+    if (bShouldDelete)
+    {
+        for ( Iterator it = data.begin(); it != data.end(); ++it)
+            delete *it;
+    }
+    data.clear();
+}
+
 template<typename T>
 inline T* Array<T>::Get(size_t nIndex)
 {
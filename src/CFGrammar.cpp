@@ -24,6 +24,11 @@
  */
 
 #include "CFGrammar.impl.h"
+#include "GrammarImage.impl.h"
+#include "SCell.impl.h"
+#include "Semiring.impl.h"
+
+#include <stdexcept>
 
 using namespace sartparser;
 using namespace impl;
@@ -169,3 +174,129 @@ Rules CFGrammar::getRules() const
     }
     return result;
 }
+
+//==============================================================================
+// COMPILED GRAMMAR IMPLEMENTATION
+//==============================================================================
+namespace
+{
+
+// Initial cell of a parse with Semiring, NULL if the prediction fails
+template<typename Semiring>
+SCellPtr predictHead(const SGrammar& sg)
+{
+    PredictBuffers buffers;
+    SCellPtr head = new SCell();
+    head->Init(sg);
+    if ( head->Predict<Semiring>(sg, buffers) != OK )
+    {
+        delete head;
+        return NULL;
+    }
+
+    head->Freeze();
+    return head;
+}
+
+}
+
+CompiledGrammar::CompiledGrammar(const CFGrammar& cfg)
+    : grammar_()
+    , heads_()
+{
+    //Use aliases for clearer code
+    const SGrammar& source = cfg.pimpl_->sg;
+    SGrammar& target = grammar_.pimpl_->sg;
+
+    //Same order as in the source, so symbols keep their indices
+    for(size_t i = 0; i < source.GetTCount(); i++)
+    {
+        const std::string& terminal = source.GetTByIndex(i)->GetName();
+        if (terminal != "")
+            target.AddTerminal(terminal);
+    }
+
+    for(size_t i = 0; i < source.GetNCount(); i++)
+        target.AddNonTerminal( source.GetNByIndex(i)->GetName() );
+
+    const std::string& axiom = source.GetAxiom()->GetName();
+    if ( axiom != "" )
+        target.AddAxiom( axiom );
+
+    for(size_t i = 0; i < source.GetNCount(); i++)
+    {
+        KProductionPtr prod = source.GetProduction( source.GetNByIndex(i) );
+        if (prod == NULL)
+            continue;
+
+        for(size_t j = 0; j < prod->GetRuleCount(); j++)
+        {
+            KSRulePtr rule = prod->GetRule(j);
+
+            StringVector rhs;
+            for(KTokItem tok = rule->GetFirst(); tok; tok = tok.GetNext())
+                rhs.push_back( tok.GetToken()->GetName() );
+
+            Status retCode = target.AddRule(
+                        prod->GetLHSName(), rhs, rule->GetProb(),
+                        prod->GetLabel() );
+            if (retCode != OK)
+                throw std::invalid_argument("Grammar rule could not be added");
+        }
+    }
+
+    if (target.CheckGrammar() != OK)
+        throw std::invalid_argument("Grammar check failed");
+
+    initHeads();
+}
+
+CompiledGrammar::CompiledGrammar(const std::string& imageFile)
+    : grammar_()
+    , heads_()
+{
+    MappedFile file;
+    if ( file.Open(imageFile) != OK )
+        throw std::invalid_argument("Error opening grammar image: " + imageFile);
+
+    Status retCode = GrammarImage::Read(
+                file.GetData(), file.GetSize(), grammar_.pimpl_->sg);
+    if ( retCode != OK )
+        throw std::invalid_argument("Error reading grammar image: " + imageFile);
+
+    initHeads();
+}
+
+CompiledGrammar::~CompiledGrammar()
+{
+    for(size_t i = 0; i < heads_.size(); i++)
+        delete heads_[i];
+}
+
+void CompiledGrammar::initHeads()
+{
+    const SGrammar& sg = grammar_.pimpl_->sg;
+
+    heads_.assign(SEMIRING_COUNT, NULL);
+    heads_[ SemiringTraits<semiring::Full>::INDEX ] =
+            predictHead<semiring::Full>(sg);
+    heads_[ SemiringTraits<semiring::Viterbi>::INDEX ] =
+            predictHead<semiring::Viterbi>(sg);
+    heads_[ SemiringTraits<semiring::Prefix>::INDEX ] =
+            predictHead<semiring::Prefix>(sg);
+
+    for(size_t i = 0; i < heads_.size(); i++)
+    {
+        if (heads_[i] == NULL)
+        {
+            for(size_t j = 0; j < heads_.size(); j++)
+                delete heads_[j];
+            throw std::invalid_argument("Grammar initial states failed");
+        }
+    }
+}
+
+const CFGrammar& CompiledGrammar::getGrammar() const
+{
+    return grammar_;
+}
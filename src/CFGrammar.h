@@ -165,11 +165,66 @@ private:
     class Impl;
     Impl* pimpl_;
 
-    friend class SParser;
+    template<typename Semiring>
+    friend class BasicSParser;
     friend class Stream;
+    friend class CompiledGrammar;
 
 };
 
+/// @brief Class to represent a checked grammar which can no longer change.
+///
+/// A CompiledGrammar is a copy of a CFGrammar, checked once when it is built
+/// (see CFGrammar::checkGrammar()), together with everything parsing it
+/// requires (terminal and non-terminal tables, rules and closure matrices).
+/// It cannot be modified afterwards, so any number of SParser on any number
+/// of threads can share it without locks nor copies. The initial states of a
+/// parse are also computed once here and shared by all the parsers built
+/// from it, so creating or resetting those parsers costs no prediction.
+/// @note This class cannot be copied.
+class CompiledGrammar
+{
+public:
+
+    /// @brief Constructor
+    /// @param cfg The grammar to copy, it is left unchanged and can be
+    /// modified or destroyed afterwards without affecting this one.
+    /// @throw std::invalid_argument If the grammar check fails.
+    explicit CompiledGrammar(const CFGrammar& cfg);
+    /// @brief Constructor
+    ///
+    /// Load a grammar image written by saveGrammarImage(). The image holds
+    /// the closure matrices, so loading it is much faster than compiling the
+    /// grammar again. The file is memory mapped where possible.
+    /// @param imageFile Path of the grammar image.
+    /// @throw std::invalid_argument If the file cannot be read, is not a
+    /// grammar image, or was written by another version of the library or
+    /// on another kind of machine.
+    explicit CompiledGrammar(const std::string& imageFile);
+    /// @brief Destructor
+    ~CompiledGrammar();
+
+    /// @brief Get the grammar compiled.
+    /// @returns A constant reference to the internal copy of the CFGrammar.
+    const CFGrammar& getGrammar() const;
+
+private:
+    //Forbid copying
+    CompiledGrammar(const CompiledGrammar& );
+    CompiledGrammar& operator=(const CompiledGrammar&);
+
+    void initHeads();
+
+    CFGrammar grammar_;
+
+    // Initial (predicted) cell of a parse for each semiring, frozen
+    std::vector<impl::SCellPtr> heads_;
+
+    template<typename Semiring>
+    friend class BasicSParser;
+    friend class Stream;
+};
+
 } // end of sartparser
 
 #endif // CFGRAMMAR_H
@@ -29,92 +29,6 @@
 using namespace sartparser;
 using namespace impl;
 
-SCell* CellUtils::getCellByIndex(SCell* start, size_t index )
-{
-
-    if( start->I == index )
-        return start;
-
-    SCell* cell = start;
-    if( index < start->I )
-    {
-        while(cell && cell->I != index)
-            cell = cell->PrevCell;
-    }
-    else
-    {
-        while(cell && cell->I != index)
-            cell = cell->NextCell;
-    }
-    return cell;
-}
-
-SCell* CellUtils::getNext(SCell* cell)
-{
-    return cell->NextCell;
-}
-
-SCell* CellUtils::getPrev(SCell* cell)
-{
-    return cell->PrevCell;
-}
-
-void CellUtils::setNext(SCell* cell, SCell* next)
-{
-    if( cell->NextCell )
-    {
-        destroyCells(cell, false); // forward
-    }
-    cell->NextCell = next;
-}
-
-void CellUtils::setPrev(SCell* cell, SCell* prev)
-{
-    if(cell->PrevCell)
-        destroyCells(cell, true);  // bacwards
-    cell->PrevCell = prev;
-}
-
-void CellUtils::destroyCells(SCell* start, bool backwards )
-{
-    SCell* cell = NULL;
-    if(backwards)
-    {
-        cell = start->PrevCell;
-        start->PrevCell = NULL;
-    }
-    else
-    {
-        cell = start->NextCell;
-        start->NextCell = NULL;
-    }
-
-    while(cell)
-    {
-        SCell* newCell;
-        if(backwards)
-            newCell = cell->PrevCell;
-        else
-            newCell = cell->NextCell;
-
-        delete cell;
-        cell = newCell;
-    }
-}
-
-SCell* CellUtils::split(SCell* cell)
-{
-    //This method only works on the last cell (and if there's more than 1 cell)
-    if ( !cell || cell->NextCell == NULL )
-        return NULL;
-
-    SCell* result = cell->NextCell;
-    result->PrevCell = NULL;
-    cell->NextCell = NULL;
-
-    return result;
-}
-
 void CellUtils::dumpCell(SCell* cell, std::ostream& o)
 {
     o << "States:" << std::endl;
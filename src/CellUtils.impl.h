@@ -39,20 +39,6 @@ namespace impl
 class CellUtils
 {
 public:
-    static SCell* getCellByIndex(SCell* start, size_t index);
-
-    static SCell* getNext(SCell* cell);
-
-    static SCell* getPrev(SCell* cell);
-
-    static void setNext(SCell* cell, SCell* prev);
-
-    static void setPrev(SCell* cell, SCell* prev);
-
-    static void destroyCells(SCell* start, bool backwards );
-
-    static SCell* split(SCell* cell);
-
     static void dumpCell(SCell* cell, std::ostream& o);
 private:
     static void dumpCellState(SCell*, std::ostream&, SState::Label );
@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2014 Miguel Sarabia
+ * Imperial College London
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "Chart.impl.h"
+#include "SCell.impl.h"
+
+using namespace sartparser;
+using namespace impl;
+
+Chart::Chart(SCellPtr head)
+    : chunks_()
+    , count_(0)
+    , pool_()
+    , poolLimit_(DEFAULT_POOL_LIMIT)
+{
+    Add(head);
+}
+
+Chart::Chart(const Chart& other)
+    : chunks_( other.chunks_.size(), NULL )
+    , count_( other.count_ )
+    , pool_()
+    , poolLimit_( other.poolLimit_ )
+{
+    for (size_t k = 0; k < chunks_.size(); ++k)
+    {
+        // Chunks of retired cells stay released
+        if ( other.chunks_[k] == NULL )
+            continue;
+
+        chunks_[k] = new SCellPtr[CHUNK_SIZE];
+        for (size_t i = 0; i < CHUNK_SIZE; ++i)
+        {
+            SCellPtr cell = other.chunks_[k][i];
+            if ( (k << CHUNK_BITS) + i < count_ && cell != NULL )
+                cell->AddRef();
+            chunks_[k][i] = cell;
+        }
+    }
+}
+
+Chart::~Chart()
+{
+    Truncate(1);
+    Release( Get(0) );
+
+    typedef std::vector<SCellPtr*>::iterator Iterator;
+    for (Iterator it = chunks_.begin(); it != chunks_.end(); ++it)
+        delete [] *it;
+
+    SetPoolLimit(0);
+}
+
+SCellPtr Chart::NewCell()
+{
+    if ( pool_.empty() )
+        return new SCell();
+
+    SCellPtr cell = pool_.back();
+    pool_.pop_back();
+    return cell;
+}
+
+void Chart::Discard(SCellPtr cell)
+{
+    if ( pool_.size() >= poolLimit_ )
+    {
+        delete cell;
+        return;
+    }
+
+    cell->Recycle();
+    pool_.push_back(cell);
+}
+
+void Chart::SetPoolLimit(size_t limit)
+{
+    poolLimit_ = limit;
+    while ( pool_.size() > poolLimit_ )
+    {
+        delete pool_.back();
+        pool_.pop_back();
+    }
+}
+
+size_t Chart::GetPoolLimit() const
+{
+    return poolLimit_;
+}
+
+SCellPtr Chart::Get(size_t index) const
+{
+    if (index >= count_)
+        return NULL;
+
+    // Chunks of retired cells are released
+    SCellPtr* chunk = chunks_[index >> CHUNK_BITS];
+    return (chunk) ? chunk[index & (CHUNK_SIZE - 1)] : NULL;
+}
+
+SCellPtr Chart::GetLast() const
+{
+    return Get(count_ - 1);
+}
+
+size_t Chart::GetCount() const
+{
+    return count_;
+}
+
+Status Chart::Add(SCellPtr cell)
+{
+    if ( count_ != 0 && cell->GetI() != count_ )
+    {
+        std::cerr << "ERROR: Cell " << cell->GetI()
+                  << " added at position " << count_ << std::endl;
+        return ERR_INVPARAM;
+    }
+
+    try
+    {
+        if ( (count_ >> CHUNK_BITS) == chunks_.size() )
+            chunks_.push_back( NULL );
+        if ( chunks_[count_ >> CHUNK_BITS] == NULL )
+            chunks_[count_ >> CHUNK_BITS] = new SCellPtr[CHUNK_SIZE];
+    }
+    catch(const std::bad_alloc&)
+    {
+        return ERR_OUTOFMEMORY;
+    }
+
+    ++count_;
+    Set(count_ - 1, cell);
+    cell->AddRef();
+    return OK;
+}
+
+void Chart::Set(size_t index, SCellPtr cell)
+{
+    chunks_[index >> CHUNK_BITS][index & (CHUNK_SIZE - 1)] = cell;
+}
+
+void Chart::Release(SCellPtr cell)
+{
+    if ( cell != NULL && cell->Release() == 0 )
+        Discard(cell);
+}
+
+SCellPtr Chart::Detach(size_t index)
+{
+    SCellPtr cell = Get(index);
+    if ( cell == NULL || !cell->IsShared() )
+        return cell;
+
+    SCellPtr copy = cell->Copy();
+    copy->AddRef();
+    Set(index, copy);
+    Release(cell);
+    return copy;
+}
+
+SCellPtr Chart::Split()
+{
+    if ( count_ <= 1 )
+        return NULL;
+
+    SCellPtr result = GetLast();
+    --count_;
+    return result;
+}
+
+void Chart::Truncate(size_t count)
+{
+    if ( count < 1 )
+        count = 1;
+
+    // Later cells may hold children in earlier ones, delete from the end
+    while ( count_ > count )
+        Release( Split() );
+}
+
+size_t Chart::Compact(bool keepTrees)
+{
+    size_t last = count_ - 1;
+    KSCellPtr lastCell = GetLast();
+
+    // Cells that can still be completed from, as the origin of a state of
+    // the last cell or of a state waiting on a nonterminal in a cell needed
+    // (origins are never after the cell the state is in)
+    std::vector<bool> needed(count_, false);
+    SCell::StateMap keep;
+    std::vector<KSStatePtr> pending;
+
+    for (size_t i = 0; i < lastCell->GetStateCount(); ++i)
+    {
+        KSStatePtr pS = lastCell->GetState(i);
+        needed[pS->GetK()] = true;
+        pending.push_back(pS);
+    }
+
+    for (size_t c = last; c-- > 1; )
+    {
+        KSCellPtr cell = Get(c);
+        if ( !needed[c] || !cell )
+            continue;
+
+        for (size_t i = 0; i < cell->GetStateCount(); ++i)
+        {
+            KSStatePtr pS = cell->GetState(i);
+            KTokenPtr pT = pS->GetAfterDot().GetToken();
+            if ( !pT || pT->GetType() != Token::NONTERMINAL )
+                continue;
+
+            needed[pS->GetK()] = true;
+            keep.Get( SCell::GetKey(pS) ) = NULL;
+            pending.push_back(pS);
+        }
+    }
+
+    // Every state in the Viterbi subtrees of the states kept
+    while ( keepTrees && !pending.empty() )
+    {
+        KSStatePtr pS = pending.back();
+        pending.pop_back();
+
+        for (size_t i = 0; i < pS->GetChildCount(); ++i)
+        {
+            KSStatePtr pCh = pS->GetChild(i);
+            if ( keep.Find( SCell::GetKey(pCh) ) )
+                continue;
+
+            keep.Get( SCell::GetKey(pCh) ) = NULL;
+            pending.push_back(pCh);
+        }
+    }
+
+    // Copy the states kept, the originals are needed until their children
+    // have been relinked
+    std::vector<SCellPtr> old;
+    for (size_t c = 1; c < last; ++c)
+    {
+        SCellPtr cell = Get(c);
+        if ( !cell )
+            continue;
+
+        SCellPtr copy = cell->Compact(keep);
+        if ( copy->GetStateCount() == 0 && !needed[c] )
+        {
+            delete copy;
+            copy = NULL;
+        }
+        else
+            copy->AddRef();
+        Set(c, copy);
+        old.push_back(cell);
+    }
+
+    // The states of the first cell are all predicted, they have no children
+    size_t stateCount = Get(0)->GetStateCount();
+    for (size_t c = 1; c <= last; ++c)
+    {
+        // The copies are new, only the last cell may be shared
+        SCellPtr cell = Detach(c);
+        if ( !cell )
+            continue;
+
+        cell->Relink(keep, keepTrees);
+        stateCount += cell->GetStateCount();
+    }
+
+    typedef std::vector<SCellPtr>::iterator Iterator;
+    for (Iterator it = old.begin(); it != old.end(); ++it)
+        Release(*it);
+
+    // Release the chunks left with retired cells only (never the first one,
+    // nor the one cells are being added to)
+    for (size_t k = 1; k < (last >> CHUNK_BITS); ++k)
+    {
+        if ( chunks_[k] == NULL )
+            continue;
+
+        size_t i = 0;
+        while ( i < CHUNK_SIZE && chunks_[k][i] == NULL )
+            ++i;
+
+        if ( i == CHUNK_SIZE )
+        {
+            delete [] chunks_[k];
+            chunks_[k] = NULL;
+        }
+    }
+
+    return stateCount;
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2014 Miguel Sarabia
+ * Imperial College London
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef CHART_IMPL_H
+#define CHART_IMPL_H
+
+#include "Common.h"
+
+namespace sartparser
+{
+namespace impl
+{
+
+// Sequence of cells of a parse, cell I is the one reached after reading I
+// tokens. Cells are stored in fixed size chunks, so looking up a cell is
+// O(1) and growing the chart never moves the existing entries.
+// Cells are reference counted (see SCell::AddRef()), copying a chart shares
+// all of its cells with the copy. A cell is never modified once the next one
+// has been added, so sharing is only broken (see Detach()) to change the
+// last cell. The first cell is never changed once predicted and may be frozen
+// (see SCell::Freeze()) to share it across threads.
+// Cells the parser can no longer reach may be retired by Compact(), their
+// entries are NULL from then on.
+// Cells released by the chart are kept in a pool, up to a limit, and handed
+// out again by NewCell(), so a chart truncated and grown again over and over
+// reuses the memory of its cells and states rather than reallocating it.
+class Chart
+{
+public:
+    // Takes over head, which becomes cell 0
+    Chart(SCellPtr head);
+    Chart(const Chart& other);
+    ~Chart();
+
+    // Returns an empty cell, from the pool if there is one left
+    SCellPtr NewCell();
+    // Gives back a cell from NewCell() that was never added
+    void Discard(SCellPtr cell);
+
+    // Most cells kept in the pool (DEFAULT_POOL_LIMIT by default), 0 frees
+    // every cell as soon as it is released. Copies of a chart start with an
+    // empty pool of the same limit.
+    void SetPoolLimit(size_t limit);
+    size_t GetPoolLimit() const;
+    const static size_t DEFAULT_POOL_LIMIT = 256;
+
+    SCellPtr Get(size_t index) const;
+    SCellPtr GetLast() const;
+    size_t GetCount() const;
+
+    // Appends a cell, its index has to be GetCount()
+    Status Add(SCellPtr cell);
+
+    // Removes the last cell (unless it is the first one) and hands the
+    // reference of the chart to it to the caller, returns NULL if there is
+    // nothing to remove
+    SCellPtr Split();
+
+    // Copies the cell at index if it is shared, so it can be modified, and
+    // returns it. Only the first and the last cells can be detached: the
+    // states of the other cells may be children of states in later cells.
+    SCellPtr Detach(size_t index);
+
+    // Deletes all the cells from index count onwards (the first cell is
+    // always kept)
+    void Truncate(size_t count);
+
+    // Releases the memory the parser no longer needs: a cell is kept only
+    // while a state of the last cell (or of a cell kept) starts at it, and
+    // then only its states waiting on a nonterminal. If keepTrees, the
+    // children of the states kept are kept too, so the Viterbi parse can
+    // still be built. The first and last cells are left as they are.
+    // Returns the number of states left in the chart.
+    size_t Compact(bool keepTrees);
+
+private:
+    //Charts cannot be assigned (for safety)
+    Chart& operator=(const Chart&);
+
+    void Set(size_t index, SCellPtr cell);
+    // Drops the reference of the chart to cell, which goes to the pool once
+    // no chart holds it anymore
+    void Release(SCellPtr cell);
+
+    const static size_t CHUNK_BITS = 8;
+    const static size_t CHUNK_SIZE = 1 << CHUNK_BITS;
+
+    std::vector<SCellPtr*> chunks_;
+    size_t count_;
+
+    std::vector<SCellPtr> pool_;
+    size_t poolLimit_;
+};
+
+}// end of impl namespace
+}// end of sartparser namespace
+
+#endif // CHART_IMPL_H
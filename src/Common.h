@@ -68,12 +68,24 @@ typedef double Real;
 
 //Forward definitions
 class PTerminal;
-class SParser;
+namespace semiring
+{
+struct Full;
+struct Viterbi;
+struct Prefix;
+}
+template<typename Semiring>
+class BasicSParser;
+typedef BasicSParser<semiring::Full> SParser;
 class ParseTree;
 class Prediction;
 class ViterbiParse;
+class SettledParse;
 class CFGrammar;
+class CompiledGrammar;
 class ParseProbability;
+class BatchResult;
+class Beam;
 class Rule;
 
 //Typedefs
@@ -104,6 +116,31 @@ typedef std::vector<PTerminal> PInput;
 /// @remarks This type is **not** available in *Python*.
 typedef std::vector<PInput> PInputs;
 
+/// @brief A collection of ::PInputs.
+///
+/// Contains several independent sequences, to be parsed from the start each
+/// (see SParser::parseBatch()).
+///
+/// @remarks This type is **not** available in *Python*.
+typedef std::vector<PInputs> PSequences;
+
+/// @brief A collection of ParseProbability.
+///
+/// Contains one probability per grammar terminal (see
+/// SParser::getPrefixProbabilities()).
+///
+/// @remarks In *Python*, this class cannot be instantiated as it is only used
+/// for reading. It behaves as (and can be converted to) a list.
+typedef std::vector<ParseProbability> ParseProbabilities;
+
+/// @brief A collection of BatchResult.
+///
+/// Contains one result per sequence of a batch, in the same order (see
+/// SParser::parseBatch()).
+///
+/// @remarks This type is **not** available in *Python*.
+typedef std::vector<BatchResult> BatchResults;
+
 namespace impl
 {
 //Internal forward definitions
@@ -112,6 +149,7 @@ class Array;
 
 class Cell;
 class CellUtils;
+class Chart;
 class Grammar;
 class ParseTreeUtil;
 class Production;
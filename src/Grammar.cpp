@@ -31,9 +31,14 @@ using namespace sartparser;
 using namespace impl;
 
 Grammar::Grammar() : Axiom(),
+    End(NULL),
+    Root(),
     T(Array<Token>::SHOULD_DELETE),
     N(Array<Token>::SHOULD_DELETE),
-    P(Array<Token>::SHOULD_DELETE)
+    P(Array<Token>::SHOULD_DELETE),
+    TIndex(),
+    NIndex(),
+    PByN()
 {
 }
 
@@ -55,6 +60,7 @@ Status Grammar::AddAxiom(const std::string& word)
     {
         //Axiom was already defined as a non-terminal
         Axiom.SetData(pT->GetName(), pT->GetType());
+        Axiom.SetId(pT->GetId());
         return OK;
     }
     else
@@ -67,26 +73,14 @@ Status Grammar::AddAxiom(const std::string& word)
 
 KTokenPtr Grammar::GetTerminal(const std::string& word) const
 {
-    KTokenPtr result;
-    for( unsigned int i = 0; i < T.GetCount(); ++i )
-    {
-        result = T.Get(i);
-        if( word ==  result->GetName() )
-            return result;
-    }
-    return NULL;
+    const size_t* index = TIndex.Find(word);
+    return (index) ? T.Get(*index) : NULL;
 }
 
 KTokenPtr Grammar::GetNonTerminal(const std::string& word) const
 {
-    KTokenPtr result;
-    for(size_t i = 0; i < N.GetCount(); ++i)
-    {
-        result = N.Get(i);
-        if( word == result->GetName() )
-            return result;
-    }
-    return NULL;
+    const size_t* index = NIndex.Find(word);
+    return (index) ? N.Get(*index) : NULL;
 }
 
 
@@ -105,21 +99,21 @@ ProductionPtr Grammar::GetProduction(size_t index)
 
 ProductionPtr Grammar::GetProduction(const std::string& word)
 {
-    for(size_t i = 0; i < P.GetCount(); i++)
-    {
-        ProductionPtr pProd = GetProduction(i);
-        KTokenPtr pLHS = pProd->GetLHS();
-        if( word == pLHS->GetName() )
-            return pProd;
-    }
-    return NULL;
+    const size_t* index = NIndex.Find(word);
+    if( !index || *index >= PByN.size() )
+        return NULL;
+    return PByN[*index];
 }
 
 ProductionPtr Grammar::GetProduction(KTokenPtr pT)
 {
-   if(pT)
-      return GetProduction(pT->GetName());
-   return NULL;
+   if(!pT)
+      return NULL;
+
+   int index = GetNIndex(pT);
+   if( index < 0 || static_cast<size_t>(index) >= PByN.size() )
+      return NULL;
+   return PByN[ static_cast<size_t>(index) ];
 }
 
 
@@ -148,6 +142,8 @@ Status Grammar::AddTerminal(const std::string& word)
         return OK;
     }
     TokenPtr pT = new Token(word, Token::TERMINAL);
+    TIndex.Get(word) = T.GetCount();
+    pT->SetId( static_cast<int>(T.GetCount()) );
     T.Add(pT);
     return OK;
 }
@@ -162,15 +158,21 @@ Status Grammar::AddNonTerminal(const std::string& word)
         return OK;
     }
 
+    // Nonterminals are identified by their index in N
+    int id = static_cast<int>(N.GetCount());
+
     //If axiom and current symbols are the same
     if( Axiom.GetName() == word)
     {
+        Axiom.SetId(id);
         pT = new Token(Axiom.GetName(), Axiom.GetType());
     }
     else
     {
         pT = new Token(word, Token::NONTERMINAL);
     }
+    pT->SetId(id);
+    NIndex.Get(word) = N.GetCount();
     N.Add(pT);
     return OK;
 }
@@ -200,6 +202,7 @@ Status Grammar::AddRule(const std::string& lhs, const StringVector& rhs)
     }
 
     RulePtr pR = new SRule();
+    pR->SetLHS(pProd->GetLHS());
     for(StringVector::const_iterator it = rhs.begin(); it != rhs.end(); ++it)
     {
         const std::string& word = *it;
@@ -211,6 +214,9 @@ Status Grammar::AddRule(const std::string& lhs, const StringVector& rhs)
         {
             std::cerr << "ERROR: RHS for " << pProd->GetLHSName() <<
                          " contains undefined symbol" << std::endl;
+            delete pR;
+            if( newProduction )
+                delete pProd;
             return ERR_INVPARAM;
         }
         pR->AddToken( *pT);
@@ -222,7 +228,13 @@ Status Grammar::AddRule(const std::string& lhs, const StringVector& rhs)
 
     //if production is new, add it to list of productions
     if( newProduction )
+    {
+        size_t index = static_cast<size_t>( plhs->GetId() );
+        if( index >= PByN.size() )
+            PByN.resize(N.GetCount(), NULL);
+        PByN[index] = pProd;
         P.Add(pProd);
+    }
 
     return OK;
 }
@@ -321,9 +333,16 @@ Status Grammar::CheckGrammar()
    // Add an end of string terminal and end of string token
    // to the productions for the axiom.
    if ( GetTerminal("")  == NULL)
+       AddTerminal("");
+
+   End = GetTerminal("");
+
+   if ( Root.GetCount() == 0 )
    {
-       TokenPtr terminal = new Token("", Token::TERMINAL);
-       T.Add(terminal);
+       Root.SetLHS(End);
+       Root.AddToken(Axiom);
+       Root.AddToken(*End);
+       Root.SetProb(1.0);
    }
 
    return OK;
@@ -331,22 +350,24 @@ Status Grammar::CheckGrammar()
 
 int Grammar::GetNIndex(KTokenPtr pT) const
 {
-   for(size_t i = 0; i < N.GetCount(); i++)
-   {
-      KTokenPtr pNewT = N.Get(i);
-      if(pT->SameName(*pNewT))
-	 return i;
-   }
-   return -1;
+   // Interned nonterminals carry their index in N
+   int id = pT->GetId();
+   if(pT->GetType() == Token::NONTERMINAL && id >= 0 &&
+      static_cast<size_t>(id) < N.GetCount())
+      return id;
+
+   KTokenPtr pNewT = GetNonTerminal(pT->GetName());
+   return (pNewT) ? pNewT->GetId() : -1;
 }
 
 int Grammar::GetTIndex(KTokenPtr pT) const
 {
-   for(size_t i = 0; i < T.GetCount(); i++)
-   {
-      KTokenPtr pNewT = T.Get(i);
-      if(pT->SameName(*pNewT) )
-	 return i;
-   }
-   return -1;
+   // Interned terminals carry their index in T
+   int id = pT->GetId();
+   if(pT->GetType() == Token::TERMINAL && id >= 0 &&
+      static_cast<size_t>(id) < T.GetCount())
+      return id;
+
+   KTokenPtr pNewT = GetTerminal(pT->GetName());
+   return (pNewT) ? pNewT->GetId() : -1;
 }
@@ -29,6 +29,7 @@
 #define __GRAMMAR_HPP
 
 #include "Common.h"
+#include "HashMap.impl.h"
 #include "Production.impl.h"
 #include "Token.impl.h"
 
@@ -52,6 +53,11 @@ class Grammar
               KTokenPtr GetTerminal(const std::string& ) const;
               KTokenPtr GetNonTerminal(const std::string&) const;
               KTokenPtr GetAxiom() const;
+              // End-of-string terminal (""), NULL until CheckGrammar()
+              KTokenPtr GetEnd() const {return End;}
+              // Rule of the root parse state ("" -> Axiom ""),
+              // empty until CheckGrammar()
+              KSRulePtr GetRoot() const {return &Root;}
 
               ProductionPtr GetProduction(const std::string&);
               ProductionPtr GetProduction(KTokenPtr pT);
@@ -72,9 +78,21 @@ class Grammar
 
    protected:
       Token   Axiom;
+      KTokenPtr End;
+      SRule   Root;
+      // Symbol table: terminals and nonterminals are interned with their
+      // index in T and N respectively (see Token::GetId())
       Array<Token> T;
       Array<Token> N;
       Array<Production> P;
+
+   private:
+      // Name to index in T and N
+      HashMap<std::string, size_t> TIndex;
+      HashMap<std::string, size_t> NIndex;
+      // Production for each nonterminal, by index in N (NULL until the
+      // first rule for it is added)
+      std::vector<ProductionPtr> PByN;
 };
 
 
@@ -0,0 +1,427 @@
+/*
+ * Copyright (c) 2014 Miguel Sarabia
+ * Imperial College London
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+
+#include "GrammarImage.impl.h"
+#include "SGrammar.impl.h"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdint.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SARTPARSER_MMAP
+#endif
+
+using namespace sartparser;
+using namespace impl;
+
+namespace
+{
+typedef SGrammar::SparseMatrix SparseMatrix;
+
+const char MAGIC[8] = {'S', 'A', 'R', 'T', 'G', 'R', 'M', '\0'};
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+//==============================================================================
+// WRITING
+//==============================================================================
+void writeU32(std::ostream& o, size_t value)
+{
+    uint32_t v = static_cast<uint32_t>(value);
+    o.write(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+void writeReal(std::ostream& o, Real value)
+{
+    o.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void writeString(std::ostream& o, const std::string& s)
+{
+    writeU32(o, s.size());
+    o.write(s.data(), static_cast<std::streamsize>(s.size()));
+}
+
+void writeMatrix(std::ostream& o, const SparseMatrix& m)
+{
+    writeU32(o, static_cast<size_t>(m.rows()));
+    writeU32(o, static_cast<size_t>(m.cols()));
+    writeU32(o, static_cast<size_t>(m.nonZeros()));
+    for(Eigen::Index row = 0; row < m.outerSize(); ++row)
+    {
+        for(SparseMatrix::InnerIterator it(m, row); it; ++it)
+        {
+            writeU32(o, static_cast<size_t>(it.row()));
+            writeU32(o, static_cast<size_t>(it.col()));
+            writeReal(o, it.value());
+        }
+    }
+}
+
+//==============================================================================
+// READING
+//==============================================================================
+// Reads values one after the other from an image, reading past its end
+// makes every later read fail
+class Reader
+{
+public:
+    Reader(const char* data, size_t size)
+        : pos_(data)
+        , end_(data + size)
+    {
+    }
+
+    bool ReadBytes(void* dest, size_t size)
+    {
+        if ( pos_ == NULL || static_cast<size_t>(end_ - pos_) < size )
+        {
+            pos_ = NULL;
+            return false;
+        }
+
+        std::memcpy(dest, pos_, size);
+        pos_ += size;
+        return true;
+    }
+
+    bool ReadU32(size_t& value)
+    {
+        uint32_t v = 0;
+        if ( !ReadBytes(&v, sizeof(v)) )
+            return false;
+
+        value = v;
+        return true;
+    }
+
+    bool ReadReal(Real& value)
+    {
+        return ReadBytes(&value, sizeof(value));
+    }
+
+    // count items of at least minSize bytes each have to fit in the image,
+    // so a corrupt count cannot make us allocate (nor loop) too much
+    bool ReadCount(size_t& count, size_t minSize)
+    {
+        if ( !ReadU32(count) )
+            return false;
+
+        if ( count > static_cast<size_t>(end_ - pos_) / minSize )
+        {
+            pos_ = NULL;
+            return false;
+        }
+        return true;
+    }
+
+    bool ReadString(std::string& s)
+    {
+        size_t size;
+        if ( !ReadCount(size, 1) )
+            return false;
+
+        s.assign(pos_, size);
+        pos_ += size;
+        return true;
+    }
+
+    // Closure matrices are size x size
+    bool ReadMatrix(SparseMatrix& m, size_t size)
+    {
+        size_t rows, cols, count;
+        if ( !ReadU32(rows) || !ReadU32(cols) || rows != size || cols != size ||
+             !ReadCount(count, 2 * sizeof(uint32_t) + sizeof(Real)) )
+            return false;
+
+        typedef Eigen::Triplet<Real> Entry;
+        std::vector<Entry> entries;
+        entries.reserve(count);
+        for(size_t i = 0; i < count; i++)
+        {
+            size_t row, col;
+            Real value;
+            if ( !ReadU32(row) || !ReadU32(col) || !ReadReal(value) ||
+                 row >= rows || col >= cols )
+                return false;
+
+            entries.push_back( Entry( static_cast<int>(row),
+                                      static_cast<int>(col), value ) );
+        }
+
+        m.resize( static_cast<Eigen::Index>(rows),
+                  static_cast<Eigen::Index>(cols) );
+        m.setFromTriplets(entries.begin(), entries.end());
+        return true;
+    }
+
+private:
+    const char* pos_;
+    const char* end_;
+};
+
+} // end of anonymous namespace
+
+//==============================================================================
+// GRAMMAR IMAGE METHODS
+//==============================================================================
+Status GrammarImage::Write(std::ostream& o, const SGrammar& g)
+{
+    // Only checked grammars have closures
+    if ( g.GetEnd() == NULL )
+        return ERR_INVPARAM;
+
+    o.write(MAGIC, sizeof(MAGIC));
+    writeU32(o, VERSION);
+    writeU32(o, BYTE_ORDER_MARK);
+    writeU32(o, sizeof(Real));
+
+    // Symbols in index order, so they get the same ids when read back
+    writeU32(o, g.GetTCount());
+    for(size_t i = 0; i < g.GetTCount(); i++)
+        writeString(o, g.GetTByIndex(i)->GetName());
+
+    writeU32(o, g.GetNCount());
+    for(size_t i = 0; i < g.GetNCount(); i++)
+        writeString(o, g.GetNByIndex(i)->GetName());
+
+    writeString(o, g.GetAxiom()->GetName());
+
+    std::vector<KProductionPtr> productions;
+    for(size_t i = 0; i < g.GetNCount(); i++)
+    {
+        KProductionPtr prod = g.GetProduction( g.GetNByIndex(i) );
+        if (prod != NULL)
+            productions.push_back(prod);
+    }
+
+    writeU32(o, productions.size());
+    for(size_t i = 0; i < productions.size(); i++)
+    {
+        KProductionPtr prod = productions[i];
+        writeString(o, prod->GetLHSName());
+        writeString(o, prod->GetLabel());
+        writeU32(o, prod->GetRuleCount());
+        for(size_t j = 0; j < prod->GetRuleCount(); j++)
+        {
+            KSRulePtr rule = prod->GetRule(j);
+            writeReal(o, rule->GetProb());
+
+            writeU32(o, rule->GetCount());
+            for(KTokItem tok = rule->GetFirst(); tok; tok = tok.GetNext())
+                writeString(o, tok.GetToken()->GetName());
+        }
+    }
+
+    writeMatrix(o, g.GetPlMatrix());
+    writeMatrix(o, g.GetRlMatrix());
+    writeMatrix(o, g.GetPuMatrix());
+    writeMatrix(o, g.GetRuMatrix());
+
+    return (o.good()) ? OK : ERR_INVPARAM;
+}
+
+Status GrammarImage::Read(const char* data, size_t size, SGrammar& g)
+{
+    Reader r(data, size);
+
+    char magic[sizeof(MAGIC)];
+    size_t version, byteOrder, realSize;
+    if ( !r.ReadBytes(magic, sizeof(magic)) ||
+         std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+         !r.ReadU32(version) || !r.ReadU32(byteOrder) || !r.ReadU32(realSize) )
+    {
+        std::cerr << "ERROR: Not a grammar image" << std::endl;
+        return ERR_READINGFILE;
+    }
+
+    if ( version != VERSION || byteOrder != BYTE_ORDER_MARK ||
+         realSize != sizeof(Real) )
+    {
+        std::cerr << "ERROR: Grammar image was written by another version "
+                  << "of the library or on another platform" << std::endl;
+        return ERR_READINGFILE;
+    }
+
+    size_t count;
+    std::string name;
+    Status retCode = OK;
+
+    if ( !r.ReadCount(count, sizeof(uint32_t)) )
+        return ERR_READINGFILE;
+    for(size_t i = 0; i < count && retCode == OK; i++)
+    {
+        if ( !r.ReadString(name) )
+            return ERR_READINGFILE;
+        retCode = g.AddTerminal(name);
+    }
+
+    if ( !r.ReadCount(count, sizeof(uint32_t)) )
+        return ERR_READINGFILE;
+    for(size_t i = 0; i < count && retCode == OK; i++)
+    {
+        if ( !r.ReadString(name) )
+            return ERR_READINGFILE;
+        retCode = g.AddNonTerminal(name);
+    }
+
+    if ( retCode != OK || !r.ReadString(name) )
+        return ERR_READINGFILE;
+    if ( name != "" && g.AddAxiom(name) != OK )
+        return ERR_READINGFILE;
+
+    size_t productionCount;
+    if ( !r.ReadCount(productionCount, 3 * sizeof(uint32_t)) )
+        return ERR_READINGFILE;
+    for(size_t i = 0; i < productionCount; i++)
+    {
+        std::string lhs, label;
+        size_t ruleCount;
+        if ( !r.ReadString(lhs) || !r.ReadString(label) ||
+             !r.ReadCount(ruleCount, sizeof(Real) + sizeof(uint32_t)) )
+            return ERR_READINGFILE;
+
+        for(size_t j = 0; j < ruleCount; j++)
+        {
+            Real probability;
+            if ( !r.ReadReal(probability) ||
+                 !r.ReadCount(count, sizeof(uint32_t)) )
+                return ERR_READINGFILE;
+
+            StringVector rhs(count);
+            for(size_t k = 0; k < count; k++)
+            {
+                if ( !r.ReadString(rhs[k]) )
+                    return ERR_READINGFILE;
+            }
+
+            if ( g.AddRule(lhs, rhs, probability, label) != OK )
+                return ERR_READINGFILE;
+        }
+    }
+
+    size_t nCount = g.GetNCount();
+    SparseMatrix pl, rl, pu, ru;
+    if ( !r.ReadMatrix(pl, nCount) || !r.ReadMatrix(rl, nCount) ||
+         !r.ReadMatrix(pu, nCount) || !r.ReadMatrix(ru, nCount) )
+        return ERR_READINGFILE;
+
+    if ( g.CheckGrammar(pl, rl, pu, ru) != OK )
+        return ERR_READINGFILE;
+
+    return OK;
+}
+
+//==============================================================================
+// MAPPED FILE METHODS
+//==============================================================================
+MappedFile::MappedFile()
+    : data_(NULL)
+    , size_(0)
+    , mapped_(false)
+    , buffer_()
+{
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+Status MappedFile::Open(const std::string& path)
+{
+    Close();
+
+#ifdef SARTPARSER_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if ( fd < 0 )
+        return ERR_READINGFILE;
+
+    struct stat info;
+    if ( fstat(fd, &info) != 0 )
+    {
+        close(fd);
+        return ERR_READINGFILE;
+    }
+
+    size_t size = static_cast<size_t>(info.st_size);
+    if ( size > 0 )
+    {
+        void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if ( data != MAP_FAILED )
+        {
+            data_ = static_cast<const char*>(data);
+            size_ = size;
+            mapped_ = true;
+        }
+    }
+    close(fd);
+
+    if ( mapped_ || size == 0 )
+        return OK;
+#endif
+
+    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+    if ( !file.is_open() )
+        return ERR_READINGFILE;
+
+    buffer_.assign( std::istreambuf_iterator<char>(file),
+                    std::istreambuf_iterator<char>() );
+    if ( file.bad() )
+        return ERR_READINGFILE;
+
+    data_ = (buffer_.empty()) ? NULL : &buffer_[0];
+    size_ = buffer_.size();
+    return OK;
+}
+
+void MappedFile::Close()
+{
+#ifdef SARTPARSER_MMAP
+    if ( mapped_ )
+        munmap(const_cast<char*>(data_), size_);
+#endif
+
+    data_ = NULL;
+    size_ = 0;
+    mapped_ = false;
+    buffer_.clear();
+}
+
+const char* MappedFile::GetData() const
+{
+    return data_;
+}
+
+size_t MappedFile::GetSize() const
+{
+    return size_;
+}
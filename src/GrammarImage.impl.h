@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2014 Miguel Sarabia
+ * Imperial College London
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+
+#ifndef GRAMMARIMAGE_IMPL_H
+#define GRAMMARIMAGE_IMPL_H
+
+#include "Common.h"
+
+namespace sartparser
+{
+namespace impl
+{
+
+// Versioned binary image of a checked SGrammar: its symbol tables, its rules
+// and its closure matrices. Reading an image rebuilds the grammar without
+// computing the closures again. Images are only read back by the same
+// version of the library on the same kind of machine (the header records the
+// version, the byte order and the size of Real, any mismatch is rejected).
+struct GrammarImage
+{
+    const static unsigned int VERSION = 1;
+
+    static Status Write(std::ostream& o, const SGrammar& g);
+    // g must be empty
+    static Status Read(const char* data, size_t size, SGrammar& g);
+};
+
+// Read-only contents of a whole file, memory mapped where the platform
+// allows it (read into memory otherwise)
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    Status Open(const std::string& path);
+
+    const char* GetData() const;
+    size_t GetSize() const;
+
+private:
+    //Mapped files cannot be copied (for safety)
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    void Close();
+
+    const char* data_;
+    size_t size_;
+    bool mapped_;
+    std::vector<char> buffer_;
+};
+
+}// end of impl namespace
+}// end of sartparser namespace
+
+#endif // GRAMMARIMAGE_IMPL_H
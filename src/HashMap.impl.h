@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2014 Miguel Sarabia
+ * Imperial College London
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef HASHMAP_IMPL_H
+#define HASHMAP_IMPL_H
+
+#include "Common.h"
+
+namespace sartparser
+{
+namespace impl
+{
+
+// Hash functors for the key types used inside the library
+template<typename T>
+struct Hash;
+
+template<>
+struct Hash<size_t>
+{
+    size_t operator()(size_t key) const
+    {
+        // Integer mixer, spreads consecutive keys over the whole table
+        size_t h = key;
+        h = ((h >> 16) ^ h) * static_cast<size_t>(0x45d9f3bU);
+        h = ((h >> 16) ^ h) * static_cast<size_t>(0x45d9f3bU);
+        h = (h >> 16) ^ h;
+        return h;
+    }
+};
+
+template<>
+struct Hash<std::string>
+{
+    size_t operator()(const std::string& key) const
+    {
+        // FNV-1a
+        size_t h = static_cast<size_t>(2166136261U);
+        for (std::string::const_iterator it = key.begin(); it != key.end(); ++it)
+        {
+            h ^= static_cast<unsigned char>(*it);
+            h *= static_cast<size_t>(16777619U);
+        }
+        return h;
+    }
+};
+
+// Combine a new value into an existing hash (as in boost::hash_combine)
+inline size_t HashCombine(size_t seed, size_t value)
+{
+    return seed ^ (value + static_cast<size_t>(0x9e3779b9U)
+                   + (seed << 6) + (seed >> 2));
+}
+
+
+// Open addressing (linear probing) hash map. Elements cannot be erased, only
+// the whole map can be cleared, which is all the parser needs.
+template<typename Key, typename Value, typename Hasher = Hash<Key> >
+class HashMap
+{
+public:
+    HashMap();
+
+    Value* Find(const Key& key);
+    const Value* Find(const Key& key) const;
+
+    // Returns the value for key, inserting a default constructed one if needed
+    Value& Get(const Key& key);
+
+    size_t GetCount() const;
+    void Clear();
+    // Empties the map but keeps its slots for the next elements
+    void Recycle();
+
+private:
+    struct Slot
+    {
+        Slot() : key(), value(), used(false) {}
+
+        Key key;
+        Value value;
+        bool used;
+    };
+
+    size_t Locate(const Key& key) const;
+    void Grow();
+
+    std::vector<Slot> slots_;
+    size_t count_;
+    Hasher hasher_;
+};
+
+template<typename Key, typename Value, typename Hasher>
+inline HashMap<Key, Value, Hasher>::HashMap()
+    : slots_()
+    , count_(0)
+    , hasher_()
+{
+}
+
+template<typename Key, typename Value, typename Hasher>
+inline size_t HashMap<Key, Value, Hasher>::Locate(const Key& key) const
+{
+    // Capacity is always a power of two
+    size_t mask = slots_.size() - 1;
+    size_t i = hasher_(key) & mask;
+
+    while ( slots_[i].used && !(slots_[i].key == key) )
+        i = (i + 1) & mask;
+
+    return i;
+}
+
+template<typename Key, typename Value, typename Hasher>
+inline Value* HashMap<Key, Value, Hasher>::Find(const Key& key)
+{
+    if ( slots_.empty() )
+        return NULL;
+
+    Slot& slot = slots_[ Locate(key) ];
+    return (slot.used) ? &slot.value : NULL;
+}
+
+template<typename Key, typename Value, typename Hasher>
+inline const Value* HashMap<Key, Value, Hasher>::Find(const Key& key) const
+{
+    return const_cast<HashMap*>(this)->Find(key);
+}
+
+template<typename Key, typename Value, typename Hasher>
+inline Value& HashMap<Key, Value, Hasher>::Get(const Key& key)
+{
+    // Keep load factor under 1/2 so probe sequences stay short
+    if ( 2 * (count_ + 1) > slots_.size() )
+        Grow();
+
+    Slot& slot = slots_[ Locate(key) ];
+    if ( !slot.used )
+    {
+        slot.used = true;
+        slot.key = key;
+        ++count_;
+    }
+    return slot.value;
+}
+
+template<typename Key, typename Value, typename Hasher>
+inline size_t HashMap<Key, Value, Hasher>::GetCount() const
+{
+    return count_;
+}
+
+template<typename Key, typename Value, typename Hasher>
+inline void HashMap<Key, Value, Hasher>::Clear()
+{
+    slots_.clear();
+    count_ = 0;
+}
+
+template<typename Key, typename Value, typename Hasher>
+inline void HashMap<Key, Value, Hasher>::Recycle()
+{
+    typedef typename std::vector<Slot>::iterator Iterator;
+    for (Iterator it = slots_.begin(); it != slots_.end() && count_ > 0; ++it)
+    {
+        if ( it->used )
+        {
+            *it = Slot();
+            --count_;
+        }
+    }
+}
+
+template<typename Key, typename Value, typename Hasher>
+inline void HashMap<Key, Value, Hasher>::Grow()
+{
+    std::vector<Slot> old;
+    old.swap(slots_);
+
+    slots_.resize( old.empty() ? 16 : 2 * old.size() );
+
+    typedef typename std::vector<Slot>::const_iterator Iterator;
+    for (Iterator it = old.begin(); it != old.end(); ++it)
+    {
+        if ( it->used )
+            slots_[ Locate(it->key) ] = *it;
+    }
+}
+
+}// end of impl namespace
+}// end of sartparser namespace
+
+#endif // HASHMAP_IMPL_H
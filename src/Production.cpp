@@ -66,4 +66,5 @@ void Production::AddRule(RulePtr pList)
 void Production::SetLHS(KTokenPtr pT)
 {
    LHS.SetData(pT->GetName(), pT->GetType());
+   LHS.SetId(pT->GetId());
 }
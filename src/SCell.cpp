@@ -29,22 +29,38 @@
 #include "SState.impl.h"
 #include "SCell.impl.h"
 #include "SGrammar.impl.h"
-#include "CellUtils.impl.h"
+#include "Chart.impl.h"
+#include "SParserUtils.h"
+#include "Semiring.impl.h"
 
+#include <algorithm>
 #include <cmath>
+#include <functional>
+#include <limits>
 
 using namespace sartparser;
 using namespace impl;
 
 
-SCell::SCell(bool partial)
-    : States(Array<StateType>::SHOULD_DELETE)
-    , NextCell(NULL)
-    , PrevCell(NULL)
+SCell::SCell()
+    : States(Array<StateType>::NO_DELETE)
+    , StatePool()
+    , ChildPool()
+    , Scanned()
+    , StateIndex()
+    , WaitingN()
+    , WaitingT()
     , I(0)
-    , partial_(partial)
     , highMark_(0.0)
     , highMarkSet_(false)
+    , keepChildren_(true)
+    , scaling_(false)
+    , logScale_(0.0)
+    , beam_(NULL)
+    , bestAlpha_(0.0)
+    , pruned_(0)
+    , refs_(0)
+    , frozen_(false)
 {
 }
 
@@ -52,48 +68,34 @@ SCell::~SCell()
 {
 }
 
-void SCell::Init(SGrammar& g)
-{
-    if(partial_)
-    {
-        g.AddNonTerminal("?");
-        g.SetPartial(true);
-    }
-    //Call const-version
-    Init(const_cast<const SGrammar&>(g));
-}
-
-
 void SCell::Init(const SGrammar& g)
 {
     SStatePtr pS = MakeNewState();
 
-    pS->AddToken(*g.GetAxiom());
-    pS->AddToken(*g.GetTerminal(""));
-
+    // Root state: "" -> . Axiom ""
+    pS->SetRule(g.GetRoot());
     pS->SetK(0);
     pS->SetDot(0);
     pS->SetLabel(SState::COMPLETED);
-    States.Add(pS);
-
-    // If need to track all the partial derivations,
-    // seed with "0: ->.?" also.
-    if(partial_)
-    {
-        KTokenPtr pNewT = g.GetNonTerminal("?");
-
-        SStatePtr pS = MakeNewState();
-        pS->AddToken(*pNewT);
-        pS->SetK(0);
-        pS->SetDot(0);
-        pS->SetLabel(SState::COMPLETED);
-        States.Add(pS);
-    }
+    AddState<semiring::Full>(pS);
 }
 
 
-Status SCell::Predict(const SGrammar& G)
+template<typename Semiring>
+Status SCell::Predict(const SGrammar& G, PredictBuffers& buffers)
 {
+    typedef SemiringTraits<Semiring> Traits;
+
+    size_t NCount = G.GetNCount();
+
+    // Total alpha of the states waiting on each nonterminal Z, and the
+    // nonterminals in the order they were first seen
+    std::vector<Real>& ZAlpha = buffers.ZAlpha;
+    std::vector<bool>& ZSeen = buffers.ZSeen;
+    std::vector<size_t>& ZOrder = buffers.ZOrder;
+    ZAlpha.assign(NCount, 0.0);
+    ZSeen.assign(NCount, false);
+    ZOrder.clear();
 
     size_t stateCount = States.GetCount();
     for(size_t i = 0; i < stateCount; i++)
@@ -104,7 +106,7 @@ Status SCell::Predict(const SGrammar& G)
         if(pS->IsFinished())//YAI || pS->IsPredicted())
             continue;
 
-        TokItem pTI = pS->GetAfterDot();
+        KTokItem pTI = pS->GetAfterDot();
         if(!pTI )
         {
             std::cerr << "ERROR: Invalid state " << I
@@ -119,105 +121,105 @@ Status SCell::Predict(const SGrammar& G)
         if(pT->GetType() == Token::TERMINAL)
             continue;
 
-        // Check if it is a "?"
-        if((partial_) && ( pT->GetName() == "?"))
+        size_t ZIndex = static_cast<size_t>( G.GetNIndex(pT) );
+        if( !ZSeen[ZIndex] )
         {
-            // Generate predictions for all non-terminals
-            size_t NCount = G.GetNCount() - 1; // -1 for "?"
-            KTokenPtr pT  = G.GetTerminal("");
-            for(size_t j = 0; j < NCount; j++)
-            {
-                KTokenPtr pN = G.GetNByIndex(j);
-                SStatePtr pNewS = MakeNewState();
-                pNewS->AddToken( *pN );
-                pNewS->SetProb(0.0);
-                pNewS->SetDot(0);
-                pNewS->SetK(I);
-                pNewS->SetLowMark(highMark_);
-                pNewS->SetHiMark(highMark_);
-                pNewS->SetLHS( *pT );
-                pNewS->SetLabel(SState::PREDICTED);
-
-                Real NewAlpha = 0.0;
-                pNewS->SetAlpha(NewAlpha);
-                pNewS->SetGamma(1.0);
-                pNewS->SetV( std::log(1) );
-
-                // Do not need to update Gamma
-                if(AddState(pNewS, true, false) == ERR_ALREADYEXISTS)
-                    delete pNewS;
-            }
-            std::cerr << "WARNING: Handling '?' prediction" << std::endl;
-            continue;
+            ZSeen[ZIndex] = true;
+            ZOrder.push_back(ZIndex);
         }
+        if(Traits::FORWARD)
+            ZAlpha[ZIndex] += pS->GetAlpha();
+    }
 
-        // At this point pT is a next nonterminal in the production.
-        // We need to iterate through Rl's row corresponding to
-        // pT and find all the nonterminals that are in LC relation
-        // with it. Then we need to scan the grammar for possible
-        // rules that have those non-terminals as LHS and stick them
-        // into States computing new alphas and gammas.
-        int ZIndex = G.GetNIndex(pT);
-        size_t TableSize = G.GetNCount();
-        if(partial_)
-            TableSize--;
-
-        for(size_t CIndex = 0; CIndex < TableSize; CIndex++)
+    // Every nonterminal C in LC relation with some Z (Z itself included
+    // with weight of at least 1.0) gets alpha(Z) * Rl(Z,C) from it. Only the
+    // nonzero entries of each row of Rl are visited.
+    std::vector<Real>& CAlpha = buffers.CAlpha;
+    std::vector<bool>& CSeen = buffers.CSeen;
+    std::vector<size_t>& COrder = buffers.COrder;
+    CAlpha.assign(NCount, 0.0);
+    CSeen.assign(NCount, false);
+    COrder.clear();
+    typedef SGrammar::SparseMatrix::InnerIterator RlIterator;
+    for(size_t i = 0; i < ZOrder.size(); i++)
+    {
+        size_t ZIndex = ZOrder[i];
+        for(RlIterator it(G.GetRlMatrix(), static_cast<int>(ZIndex)); it; ++it)
         {
-            Real ClosureProb = G.GetRl(ZIndex, CIndex);
+            Real ClosureProb = it.value();
             if(ClosureProb <= 0)	// Closure < 0 - numerical error, ignore
                 continue;
 
-            // Get the token which is in LC relationship with pT (pT itself
-            // will also be included with weight of at least 1.0).
-            KTokenPtr pTC = G.GetNByIndex(CIndex);
-
-            // Find all the productions for it and stick them into
-            // States with the dot at 0.
-            KProductionPtr pP = G.GetProduction(pTC);
-            if(!pP)
+            size_t CIndex = static_cast<size_t>( it.col() );
+            if( !CSeen[CIndex] )
             {
-                //Should never happen - it is checked while reading grammar
-                std::cerr << "WARNING: Nonterminal " << pTC->GetName()
-                          << "is missing production" << std::endl;
-                continue;
+                CSeen[CIndex] = true;
+                COrder.push_back(CIndex);
             }
+            if(Traits::FORWARD)
+                CAlpha[CIndex] += ZAlpha[ZIndex] * ClosureProb;
+        }
+    }
 
-            for(size_t j = 0; j < pP->GetRuleCount(); j++)
+    // Stick the rules of each predicted nonterminal into States with the
+    // dot at 0, once per rule.
+    for(size_t i = 0; i < COrder.size(); i++)
+    {
+        size_t CIndex = COrder[i];
+        KTokenPtr pTC = G.GetNByIndex(CIndex);
+
+        KProductionPtr pP = G.GetProduction(pTC);
+        if(!pP)
+        {
+            //Should never happen - it is checked while reading grammar
+            std::cerr << "WARNING: Nonterminal " << pTC->GetName()
+                      << "is missing production" << std::endl;
+            continue;
+        }
+
+        for(size_t j = 0; j < pP->GetRuleCount(); j++)
+        {
+            KSRulePtr pR = pP->GetRule(j);
+            SStatePtr pNewS = MakeNewState();
+            pNewS->SetRule( pR );
+            pNewS->SetDot(0);
+            pNewS->SetK(I);
+            pNewS->SetLowMark(highMark_);
+            pNewS->SetHiMark(highMark_);
+            pNewS->SetLabel(SState::PREDICTED);
+
+            Real NewAlpha = 0.0;
+            Real NewGamma = 0.0;
+            if(Traits::FORWARD)
             {
-                KSRulePtr pR = pP->GetRule(j);
-                SStatePtr pNewS = MakeNewState();
-                pNewS->SetRule( *pR );
-                pNewS->SetProb(pR->GetProb());
-                pNewS->SetDot(0);
-                pNewS->SetK(I);
-                pNewS->SetLowMark(highMark_);
-                pNewS->SetHiMark(highMark_);
-                pNewS->SetLHS( *pTC );
-                pNewS->SetLabel(SState::PREDICTED);
-
-                Real NewAlpha =
-                        pS->GetAlpha() * ClosureProb * pNewS->GetProb();
-                pNewS->SetAlpha(NewAlpha);
-                pNewS->SetGamma(pNewS->GetProb());
+                NewAlpha = CAlpha[CIndex] * pNewS->GetProb();
+                NewGamma = pNewS->GetProb();
+            }
+            pNewS->SetAlpha(NewAlpha);
+            pNewS->SetGamma(NewGamma);
+            if(Traits::VITERBI)
                 pNewS->SetV( std::log(pNewS->GetProb()) );
 
-                // Do not need to update Gamma
-                if(AddState(pNewS, true, false) == ERR_ALREADYEXISTS)
-                    delete pNewS;
-            }
+            // Do not need to update Gamma
+            if((Traits::FORWARD && Prune(pNewS)) ||
+               AddState<Semiring>(pNewS, true, false) == ERR_ALREADYEXISTS)
+                FreeState(pNewS);
         }
     }
 
+    if(Traits::FORWARD)
+        ApplyBeam();
     return OK;
 }
 
-// Returns a new Cell, with the Scanned set filled in
-// and adds the cell to a chain.
-SCellPtr SCell::Scan(const Line& tokens)
+// Fills pCell in with the Scanned set
+// (the caller is responsible for adding it to the chart).
+template<typename Semiring>
+Status SCell::Scan(const Line& tokens, SCellPtr pCell) const
 {
-    SCellPtr pCell = new SCell(partial_);
     pCell->SetI(GetI() + 1);
+    pCell->logScale_ = logScale_;
+    pCell->Scanned = tokens;
 
     // For each Token in the input bank do the normal scan
     for(Line::const_iterator tok = tokens.begin(); tok != tokens.end(); ++tok)
@@ -233,20 +235,26 @@ SCellPtr SCell::Scan(const Line& tokens)
                 pCell->SetHigh(HiMark);
         }
 
-        if(Scan(*tok, pCell) != OK)
-        {
-            delete pCell;
-            return NULL;
-        }
+        Status retCode = Scan<Semiring>(*tok, pCell);
+        if(retCode != OK)
+            return retCode;
     }
 
-    CellUtils::setNext(this, pCell);
-    CellUtils::setPrev(pCell, this);
-    return pCell;
+    if(SemiringTraits<Semiring>::FORWARD)
+    {
+        if(pCell->scaling_)
+            pCell->Rescale();
+
+        pCell->ApplyBeam();
+    }
+    return OK;
 }
 
-Status SCell::Complete(const SGrammar& sg)
+template<typename Semiring>
+Status SCell::Complete(const SGrammar& sg, const Chart& chart)
 {
+    typedef SemiringTraits<Semiring> Traits;
+
     for(size_t i = 0; i < States.GetCount(); i++)
     {
         SStatePtr pS = States.Get(i);
@@ -261,13 +269,13 @@ Status SCell::Complete(const SGrammar& sg)
 #endif 
             // pT is an LHS of a current complete state.
             KTokenPtr pT = pS->GetLHS();
-            if(pT->GetName() == "")
+            if(pT->SameName(*sg.GetEnd()))
                 continue;
 
             // pC is a cell that has the dot at the
             // position, given by the beginning of the
             // current complete state.
-            SCellPtr  pC = CellUtils::getCellByIndex( this, pS->GetK() );
+            SCellPtr  pC = chart.Get( pS->GetK() );
             if(!pC)
             {
                 std::cerr << "ERROR: Invalid dot position while completing "
@@ -275,124 +283,82 @@ Status SCell::Complete(const SGrammar& sg)
                           << " at step " << I << std::endl;
                 return ERR_INVPARAM;
             }
-            // Iterate through the target parent state set backwards,
-            // checking if the nonterminal on the left of the dot
-            // can be reached from current state.
+            // Only the states of pC waiting on a nonterminal that reaches
+            // pT through unit productions (Ru) can be completed.
             int YIndex = sg.GetNIndex(pT);
-            for(size_t j = 0; j < pC->States.GetCount(); j++)
+            typedef SGrammar::SparseMatrix::InnerIterator RuIterator;
+            for(RuIterator it(sg.GetRuT(), YIndex); it; ++it)
             {
-                SStatePtr pNewS = pC->States.Get(j);
-                TokItem pNewTI = pNewS->GetAfterDot();
-                if(!pNewTI)
-                    continue;
-
-                KTokenPtr pNewT = pNewTI.GetToken();
-                if(pNewT->GetType() != Token::NONTERMINAL)
+                Real UnitProb = it.value();
+                if(UnitProb <= 0)
                     continue;
 
-                /*
-        T_REAL Penalty = Filter(G, pNewS, pS);
-        if(Penalty == 0.0)
-          continue;
-            */
-
-                if( pNewT->GetName() == "?" )
+                KTokenPtr pNewT = sg.GetNByIndex( static_cast<size_t>(it.col()) );
+                for(SStatePtr pNewS = pC->GetWaiting(pNewT); pNewS != NULL;
+                    pNewS = pNewS->GetNextWaiting())
                 {
+                    Real Penalty = Filter(sg, pNewS, pS);
+                    if(Penalty == 0.0)
+                        continue;
+
+                    // We found the non-terminal reacheable from pT
+                    // by Ru.
                     SStatePtr pAddS = MakeNewState();
                     *pAddS = *pNewS;
+                    // predicted states do not have valid marks
+                    if(pNewS->IsPredicted())
+                        pAddS->SetLowMark(pS->GetLowMark());
 
-                    // Add the pT to the end of the pAddS and advance the
-                    // dot.
-                    pAddS->AddBeforeVar( *pT );
                     pAddS->SetHiMark(pS->GetHiMark());
                     pAddS->AdvanceDot();
                     pAddS->SetLabel(SState::COMPLETED);
 
-                    Real NewGamma =
-                            // g * g'' * Ru
-                            pNewS->GetGamma() * pS->GetGamma();
+                    Real NewAlpha = 0.0;
+                    Real NewGamma = 0.0;
+                    if(Traits::FORWARD && !pS->IsUnit())
+                    {
+                        NewAlpha =
+                                // a * g'' * Ru * Penalty
+                                pNewS->GetAlpha() * pS->GetGamma() * UnitProb * Penalty;
+                        NewGamma =
+                                // g * g'' * Ru * Penalty
+                                pNewS->GetGamma() * pS->GetGamma() * UnitProb * Penalty;
+                    }
 
-                    Real NewV =
-                            // v + v''
-                            pNewS->GetV() + pS->GetV();
+                    if(Traits::VITERBI)
+                    {
+                        Real NewV =
+                                // v + v'' + log(Ru) + log(Penalty)
+                                pNewS->GetV() + pS->GetV() + std::log(UnitProb) + std::log(Penalty);
+                                // YAI Compute Length of the production to normalize
+                                // int Length = I - pS->GetK();
+                                // NewV =
+                                // pNewS->GetV() + pS->GetV()/Length + Log(UnitProb);
+                        pAddS->SetV(NewV);
+                    }
 
-                    pAddS->SetAlpha(0.0);
+                    pAddS->SetAlpha(NewAlpha);
                     pAddS->SetGamma(NewGamma);
-                    pAddS->SetV    (NewV    );
-                    pAddS->AddChild(pS);
-
-
-
-                    if(AddState(pAddS, true, true, true) == ERR_ALREADYEXISTS)
-                        delete pAddS;
-                    continue;
-                }
-
-                // We have the non-terminal
-                // Check it against the Ru to see if it is reacheable
-                // from pT.
-                int UIndex = sg.GetNIndex(pNewT);
-                Real UnitProb = sg.GetRu(UIndex, YIndex);
-                if(UnitProb <= 0)
-                    continue;
-
-                Real Penalty = Filter(sg, pNewS, pS);
-                if(Penalty == 0.0)
-                    continue;
-
-                // We found the non-terminal reacheable from pT
-                // by Ru.
-                SStatePtr pAddS = MakeNewState();
-                *pAddS = *pNewS;
-                // predicted states do not have valid marks
-                if(pNewS->IsPredicted())
-                    pAddS->SetLowMark(pS->GetLowMark());
-
-                pAddS->SetHiMark(pS->GetHiMark());
-                pAddS->AdvanceDot();
-                pAddS->SetLabel(SState::COMPLETED);
-
-                Real NewAlpha = 0.0;
-                Real NewGamma = 0.0;
-                if(!pS->IsUnit())
-                {
-                    NewAlpha =
-                            // a * g'' * Ru * Penalty
-                            pNewS->GetAlpha() * pS->GetGamma() * UnitProb * Penalty;
-                    NewGamma =
-                            // g * g'' * Ru * Penalty
-                            pNewS->GetGamma() * pS->GetGamma() * UnitProb * Penalty;
-                }
-
-                Real NewV =
-                        // v + v'' + log(Ru) + log(Penalty)
-                        pNewS->GetV() + pS->GetV() + std::log(UnitProb) + std::log(Penalty);
-                        // YAI Compute Length of the production to normalize
-                        // int Length = I - pS->GetK();
-                        // NewV =
-                        // pNewS->GetV() + pS->GetV()/Length + Log(UnitProb);
-
-                pAddS->SetAlpha(NewAlpha);
-                pAddS->SetGamma(NewGamma);
-                pAddS->SetV    (NewV    );
-                if(Prune(pAddS))
-                {
-                    delete pAddS;
-                    continue;
-                }
+                    if(Traits::FORWARD && Prune(pAddS))
+                    {
+                        FreeState(pAddS);
+                        continue;
+                    }
 
-                pAddS->AddChild(pS);
+                    if(Traits::VITERBI && keepChildren_)
+                        pAddS->AddChild(pS, ChildPool);
 
 #ifdef HEAVY_DEBUG
-                printf("Adding ");
-                pAddS->Dump(stdout);
-                printf("\n");
-                printf("\tby ");
-                pS->Dump(stdout);
-                printf("\n");
+                    printf("Adding ");
+                    pAddS->Dump(stdout);
+                    printf("\n");
+                    printf("\tby ");
+                    pS->Dump(stdout);
+                    printf("\n");
 #endif
-                if(AddState(pAddS, true, true, true) == ERR_ALREADYEXISTS)
-                    delete pAddS;
+                    if(AddState<Semiring>(pAddS, true, true, true) == ERR_ALREADYEXISTS)
+                        FreeState(pAddS);
+                }
             }
         }
     }
@@ -415,6 +381,8 @@ Status SCell::Complete(const SGrammar& sg)
         }
     }
 #endif
+    if(Traits::FORWARD)
+        ApplyBeam();
     return OK;
 }
 
@@ -435,20 +403,345 @@ Real SCell::Filter(const SGrammar& /*sg*/, SStatePtr pNewS, SStatePtr pS)
 }
 
 
-bool SCell::Prune(SStatePtr /*pS*/)
+bool SCell::Prune(SStatePtr pS)
 {
     // Returns true if need to drop this state
+    if( !beam_ || !IsPrunable(pS) )
+        return false;
+
+    // The best alpha can only grow, so a state below the beam now would
+    // be pruned by ApplyBeam() anyway
+    Real Alpha = pS->GetAlpha();
+    if( Alpha < GetThreshold() ||
+        Alpha < bestAlpha_ * beam_->relativeThreshold )
+    {
+        ++pruned_;
+        return true;
+    }
+
+    if( Alpha > bestAlpha_ )
+        bestAlpha_ = Alpha;
     return false;
 }
 
-void SCell::SetPartial(bool partial)
+bool SCell::IsPrunable(KSStatePtr pS) const
 {
-    partial_ = partial;
+    // States of the root rule are kept so that the parse can always be
+    // finished. States completed through a unit production carry no alpha
+    // of their own (Ru accounts for it) but are needed for the Viterbi parse.
+    if( pS->GetLHS()->GetType() != Token::NONTERMINAL )
+        return false;
+    if( pS->IsCompleted() && pS->GetAlpha() == 0.0 )
+        return false;
+    return true;
 }
 
-bool SCell::GetPartial() const
+void SCell::ApplyBeam()
 {
-    return partial_;
+    if( !beam_ || !beam_->isEnabled() )
+        return;
+
+    size_t count = States.GetCount();
+
+    Real best = 0.0;
+    size_t kept = 0;
+    for(size_t i = 0; i < count; i++)
+    {
+        KSStatePtr pS = States.Get(i);
+        if( !IsPrunable(pS) )
+            kept++;
+        else if( pS->GetAlpha() > best )
+            best = pS->GetAlpha();
+    }
+
+    Real cut = std::max(GetThreshold(), best * beam_->relativeThreshold);
+
+    // Alphas of the prunable states that pass the thresholds, to find the
+    // lowest alpha within the max states cap
+    std::vector<Real> alphas;
+    for(size_t i = 0; i < count; i++)
+    {
+        KSStatePtr pS = States.Get(i);
+        if( IsPrunable(pS) && pS->GetAlpha() >= cut )
+            alphas.push_back(pS->GetAlpha());
+    }
+
+    // States tied with the cut are taken in order while there is room
+    size_t ties = alphas.size();
+    if( beam_->maxStates > 0 )
+    {
+        size_t quota = (beam_->maxStates > kept) ? beam_->maxStates - kept : 0;
+        if( quota == 0 )
+        {
+            cut = std::numeric_limits<Real>::infinity();
+            ties = 0;
+        }
+        else if( quota < alphas.size() )
+        {
+            std::vector<Real>::iterator nth = alphas.begin() +
+                    static_cast<std::ptrdiff_t>(quota - 1);
+            std::nth_element(alphas.begin(), nth, alphas.end(),
+                             std::greater<Real>());
+            cut = *nth;
+
+            size_t above = 0;
+            for(size_t i = 0; i < alphas.size(); i++)
+            {
+                if( alphas[i] > cut )
+                    above++;
+            }
+            ties = quota - above;
+        }
+    }
+
+    if( alphas.size() + kept == count && ties == alphas.size() )
+        return;
+
+    // Rebuild the states and their indices with the survivors, in the same
+    // order. Dropped states stay in StatePool until the cell is destroyed,
+    // since states kept may still hold them as children.
+    std::vector<SStatePtr> states;
+    states.reserve(count);
+    for(size_t i = 0; i < count; i++)
+        states.push_back(States.Get(i));
+
+    States.Clear();
+    StateIndex.Clear();
+    WaitingN.Clear();
+    WaitingT.Clear();
+
+    for(size_t i = 0; i < count; i++)
+    {
+        SStatePtr pS = states[i];
+        if( IsPrunable(pS) )
+        {
+            Real Alpha = pS->GetAlpha();
+            if( Alpha < cut || (Alpha == cut && ties == 0) )
+            {
+                ++pruned_;
+                continue;
+            }
+            if( Alpha == cut )
+                ties--;
+        }
+
+        SStatePtr& bucket = StateIndex.Get( pS->GetHash() );
+        pS->SetNextInBucket(bucket);
+        bucket = pS;
+
+        pS->SetNextWaiting(NULL);
+        AddWaiting(pS);
+
+        States.Add(pS);
+    }
+}
+
+void SCell::SetBeam(const Beam* beam)
+{
+    beam_ = beam;
+}
+
+size_t SCell::GetPrunedCount() const
+{
+    return pruned_;
+}
+
+Real SCell::GetThreshold() const
+{
+    Real threshold = beam_->threshold;
+    if( logScale_ == 0.0 || threshold <= 0.0 )
+        return threshold;
+
+    // May well overflow (no state passes) or underflow (all of them do)
+    return std::exp( std::log(threshold) - logScale_ );
+}
+
+void SCell::Rescale()
+{
+    Real total = 0.0;
+    for(size_t i = 0; i < States.GetCount(); i++)
+        total += States.Get(i)->GetAlpha();
+
+    // Nothing scanned, the parse is over anyway
+    if( !(total > 0.0) || total == 1.0 )
+        return;
+
+    for(size_t i = 0; i < States.GetCount(); i++)
+    {
+        SStatePtr pS = States.Get(i);
+        pS->SetAlpha( pS->GetAlpha() / total );
+        pS->SetGamma( pS->GetGamma() / total );
+    }
+
+    bestAlpha_ /= total;
+    logScale_ += std::log(total);
+}
+
+void SCell::SetScaling(bool scaling)
+{
+    scaling_ = scaling;
+}
+
+Real SCell::GetLogScale() const
+{
+    return logScale_;
+}
+
+void SCell::SetKeepChildren(bool keep)
+{
+    keepChildren_ = keep;
+}
+
+size_t SCell::GetKey(KSStatePtr pS)
+{
+    return reinterpret_cast<size_t>(pS);
+}
+
+SCellPtr SCell::Compact(StateMap& keep) const
+{
+    SCellPtr pCell = new SCell();
+    pCell->I = I;
+    pCell->Scanned = Scanned;
+    pCell->highMark_ = highMark_;
+    pCell->highMarkSet_ = highMarkSet_;
+    pCell->keepChildren_ = keepChildren_;
+    pCell->scaling_ = scaling_;
+    pCell->logScale_ = logScale_;
+    pCell->beam_ = beam_;
+    pCell->pruned_ = pruned_;
+
+    size_t count = States.GetCount();
+
+    // Size the pools for exactly what is kept, compacted cells are many
+    size_t stateCount = 0;
+    size_t childCount = 0;
+    for(size_t i = 0; i < count; i++)
+    {
+        KSStatePtr pS = States.Get(i);
+        if( keep.Find( GetKey(pS) ) )
+        {
+            stateCount++;
+            childCount += pS->GetChildCount();
+        }
+    }
+    pCell->StatePool.Reserve(stateCount);
+    pCell->ChildPool.Reserve(childCount);
+
+    for(size_t i = 0; i < count; i++)
+    {
+        KSStatePtr pS = States.Get(i);
+        SStatePtr* pCopy = keep.Find( GetKey(pS) );
+        if( !pCopy )
+            continue;
+
+        SStatePtr pNewS = pCell->StatePool.New();
+        *pNewS = *pS;
+        *pCopy = pNewS;
+        pCell->States.Add(pNewS);
+    }
+
+    // Waiting lists keep their original order, so completing from the copy
+    // adds up the same values in the same order. StateIndex is left empty,
+    // it is only used to add states.
+    HashMap<size_t, bool> copied;
+    for(size_t i = 0; i < count; i++)
+    {
+        KSStatePtr pS = States.Get(i);
+        KTokenPtr pT = pS->GetAfterDot().GetToken();
+        if( !pT || !keep.Find( GetKey(pS) ) )
+            continue;
+
+        SStatePtr pHead = GetWaiting(pT);
+        bool& done = copied.Get( GetKey(pHead) );
+        if( done )
+            continue;
+        done = true;
+
+        for(SStatePtr pW = pHead; pW != NULL; pW = pW->GetNextWaiting())
+        {
+            SStatePtr* pCopy = keep.Find( GetKey(pW) );
+            if( pCopy )
+                pCell->AddWaiting(*pCopy);
+        }
+    }
+
+    return pCell;
+}
+
+void SCell::Relink(const StateMap& moved, bool keepChildren)
+{
+    std::vector<SStatePtr> children;
+    for(size_t i = 0; i < States.GetCount(); i++)
+    {
+        SStatePtr pS = States.Get(i);
+        size_t count = pS->GetChildCount();
+        if( count == 0 )
+            continue;
+
+        children.clear();
+        for(size_t j = 0; keepChildren && j < count; j++)
+        {
+            SStatePtr pCh = pS->GetChild(j);
+            const SStatePtr* pCopy = moved.Find( GetKey(pCh) );
+            children.push_back( (pCopy && *pCopy) ? *pCopy : pCh );
+        }
+
+        pS->RemoveChildren();
+        for(size_t j = 0; j < children.size(); j++)
+            pS->AddChild(children[j], ChildPool);
+    }
+}
+
+SCellPtr SCell::Copy() const
+{
+    StateMap all;
+    for(size_t i = 0; i < States.GetCount(); i++)
+        all.Get( GetKey( States.Get(i) ) ) = NULL;
+
+    SCellPtr pCell = Compact(all);
+    pCell->Relink(all, true);
+    return pCell;
+}
+
+void SCell::AddRef()
+{
+    if(!frozen_)
+        ++refs_;
+}
+
+size_t SCell::Release()
+{
+    return (frozen_) ? 1 : --refs_;
+}
+
+bool SCell::IsShared() const
+{
+    return frozen_ || refs_ > 1;
+}
+
+void SCell::Freeze()
+{
+    frozen_ = true;
+}
+
+void SCell::Recycle()
+{
+    States.Clear();
+    StatePool.Recycle();
+    ChildPool.Recycle();
+    Scanned.clear();
+    StateIndex.Recycle();
+    WaitingN.Recycle();
+    WaitingT.Recycle();
+    I = 0;
+    highMark_ = 0.0;
+    highMarkSet_ = false;
+    keepChildren_ = true;
+    scaling_ = false;
+    logScale_ = 0.0;
+    beam_ = NULL;
+    bestAlpha_ = 0.0;
+    pruned_ = 0;
 }
 
 Real SCell::GetHigh() const
@@ -475,11 +768,21 @@ void SCell::SetI(size_t index)
 SStatePtr SCell::MakeNewState()
 {
 
-    SStatePtr pS = new SState();
+    SStatePtr pS = StatePool.New();
     pS->SetV(0);
     return pS;
 }
 
+void SCell::FreeState(SStatePtr pState)
+{
+    StatePool.Free(pState);
+}
+
+const Line& SCell::GetScanned() const
+{
+    return Scanned;
+}
+
 size_t SCell::GetStateCount() const
 {
     return States.GetCount();
@@ -491,28 +794,33 @@ KSStatePtr SCell::GetState(size_t i) const
 }
 
 
+template<typename Semiring>
 Status SCell::AddState(
         SStatePtr pState,
         bool AddAlpha,
         bool AddGamma,
         bool Sorted)
 {
+    typedef SemiringTraits<Semiring> Traits;
     size_t i, j;
-    for(i = 0; i < States.GetCount(); i++)
+
+    // Only states in the same bucket can be duplicates
+    SStatePtr& bucket = StateIndex.Get( pState->GetHash() );
+    for(SStatePtr pS = bucket; pS != NULL; pS = pS->GetNextInBucket())
     {
-        SStatePtr pS = States.Get(i);
         if( pState->sameKDotAndProd( *pS ) )
         {
-            if(AddAlpha)
+            if(Traits::FORWARD && AddAlpha)
                 pS->SetAlpha(pS->GetAlpha() + pState->GetAlpha());
-            if(AddGamma)
-            {
+            if(Traits::FORWARD && AddGamma)
                 pS->SetGamma(pS->GetGamma() + pState->GetGamma());
-
+            if(Traits::VITERBI && AddGamma)
+            {
                 // Check if we just need to add the state to the
-                // children chain.
+                // children chain (no children at all without backpointers).
                 size_t LastChild = pState->GetChildCount() - 1;
-                SStatePtr pCh = pState->GetChild(LastChild);
+                SStatePtr pCh = (keepChildren_) ?
+                            pState->GetChild(LastChild) : NULL;
 
 #ifdef HEAVY_DEBUG
                 printf("Current state: ");
@@ -529,7 +837,7 @@ Status SCell::AddState(
                 }
 #endif
 
-                if(pCh->IsUnit())
+                if(pCh && pCh->IsUnit())
                 {
                     SStatePtr pCh2 = pCh->GetChild(0);
                     if(pCh2)
@@ -554,8 +862,7 @@ Status SCell::AddState(
                         }
                         if(j < ChildCount)
                         {
-                            pSCh = pS->RemoveChild(j);
-                            pS->AddChildAt(j, pCh);
+                            pS->ReplaceChild(j, pCh, ChildPool);
                             return ERR_ALREADYEXISTS;
                         }
                     }
@@ -569,9 +876,8 @@ Status SCell::AddState(
                     // Path probability maximisation
                     // Copy the predecessors (this is not right).
                     // Should only remove the predecessors with current K.
-                    pS->RemoveChildren();
-                    for(j = 0; j < pState->GetChildCount(); j++)
-                        pS->AddChild (pState->GetChild(j) );
+                    if(keepChildren_)
+                        pS->CopyChildren(*pState);
                 }
                 /*
         // In any case, copy over the predecessors of a new state
@@ -584,6 +890,11 @@ Status SCell::AddState(
         }
     }
 
+    pState->SetNextInBucket(bucket);
+    bucket = pState;
+
+    AddWaiting(pState);
+
     if(!Sorted)
         return States.Add(pState);
 
@@ -605,62 +916,84 @@ Status SCell::AddState(
 }
 
 
-Status SCell::Scan(const Token& pT, SCellPtr pCell)
+void SCell::AddWaiting(SStatePtr pState)
 {
+    KTokenPtr pT = pState->GetAfterDot().GetToken();
+    if( !pT || pT->GetId() < 0 )
+        return;
+
+    HashMap<size_t, WaitList>& index =
+            (pT->GetType() == Token::NONTERMINAL) ? WaitingN : WaitingT;
+
+    WaitList& list = index.Get( static_cast<size_t>(pT->GetId()) );
+    if( list.tail )
+        list.tail->SetNextWaiting(pState);
+    else
+        list.head = pState;
+    list.tail = pState;
+}
+
+SStatePtr SCell::GetWaiting(KTokenPtr pT) const
+{
+    if( pT->GetId() < 0 )
+        return NULL;
+
+    const HashMap<size_t, WaitList>& index =
+            (pT->GetType() == Token::NONTERMINAL) ? WaitingN : WaitingT;
+
+    const WaitList* list = index.Find( static_cast<size_t>(pT->GetId()) );
+    return (list) ? list->head : NULL;
+}
+
+template<typename Semiring>
+Status SCell::Scan(const Token& pT, SCellPtr pCell) const
+{
+    typedef SemiringTraits<Semiring> Traits;
+
     Real P = pT.GetProb();
-    size_t i;
     Status nRetCode;
-    // Go through the States set and find the appropriate
-    // states, that have the token after the dot.
-    for(i = 0; i < States.GetCount(); i++)
+    // Go through the states that have the token after the dot.
+    for(SStatePtr pS = GetWaiting(&pT); pS != NULL; pS = pS->GetNextWaiting())
     {
-        SStatePtr pS = States.Get(i);
-        if(pS->IsFinished())
-            continue;
-
-        TokItem pTI = pS->GetAfterDot();
-
-        KTokenPtr pNewT = pTI.GetToken();
-        if( pT.SameName(*pNewT) )
+        // We only come here with TOKEN_TERMINALs,
+        //so we need to set the high and low marks
+        // operator= for SState will copy the
+        // Alpha and Gamma over.
+        SStatePtr pNewS = pCell->MakeNewState();
+        *pNewS = *pS;
+
+        if( pT.GetLow() )
+            //	This should be here, except a check for the skip state also needed
+            // if(pNewS->IsPredicted())
+            pNewS->SetLowMark( pT.GetLow());
+        if(pT.GetHigh() )
+            pNewS->SetHiMark(pT.GetHigh());
+        pNewS->AdvanceDot();
+        pNewS->SetLabel(SState::SCANNED);
+        if(P != 1.0)
         {
-            // We only come here with TOKEN_TERMINALs,
-            //so we need to set the high and low marks
-            // operator= for SState will copy the
-            // Alpha and Gamma over.
-            SStatePtr pNewS = MakeNewState();
-            *pNewS = *pS;
-
-            //	 TokItem pTestTI = pNewS->GetAfterDot();
-            //	 TokenPtr pTestT = pTestTI->GetToken();
-            //	 pTestT->IsA();
-            pNewS->ReplaceAfterDot( pT );
-            //	 pTestTI = pNewS->GetAfterDot();
-            //	 pTestT = pTestTI->GetToken();
-            //	 pTestT->IsA();
-
-            if( pT.GetLow() )
-                //	This should be here, except a check for the skip state also needed
-                // if(pNewS->IsPredicted())
-                pNewS->SetLowMark( pT.GetLow());
-            if(pT.GetHigh() )
-                pNewS->SetHiMark(pT.GetHigh());
-            pNewS->AdvanceDot();
-            pNewS->SetLabel(SState::SCANNED);
-            if(P != 1.0)
+            if(Traits::FORWARD)
             {
                 pNewS->SetAlpha(pNewS->GetAlpha() * P);
                 pNewS->SetGamma(pNewS->GetGamma() * P);
-                pNewS->SetV    (pNewS->GetV() + std::log(P));
             }
+            if(Traits::VITERBI)
+                pNewS->SetV(pNewS->GetV() + std::log(P));
+        }
 
-            // Do not update neither Alpha nor Gamma
-            if((nRetCode = pCell->AddState(pNewS, false, false))
-                    == ERR_ALREADYEXISTS)
-            {
-                std::cerr << "ERROR: Duplicate state scanned." <<  std::endl;
-                delete pNewS;
-                return nRetCode;
-            }
+        if(Traits::FORWARD && pCell->Prune(pNewS))
+        {
+            pCell->FreeState(pNewS);
+            continue;
+        }
+
+        // Do not update neither Alpha nor Gamma
+        if((nRetCode = pCell->AddState<Semiring>(pNewS, false, false))
+                == ERR_ALREADYEXISTS)
+        {
+            std::cerr << "ERROR: Duplicate state scanned." <<  std::endl;
+            pCell->FreeState(pNewS);
+            return nRetCode;
         }
     }
 
@@ -676,3 +1009,16 @@ Status SCell::Scan(const Token& pT, SCellPtr pCell)
     return OK;
 }
 
+// The steps of the parse for each semiring
+template Status SCell::Predict<semiring::Full>(
+        const SGrammar&, PredictBuffers&);
+template Status SCell::Predict<semiring::Viterbi>(
+        const SGrammar&, PredictBuffers&);
+template Status SCell::Predict<semiring::Prefix>(
+        const SGrammar&, PredictBuffers&);
+template Status SCell::Scan<semiring::Full>(const Line&, SCellPtr) const;
+template Status SCell::Scan<semiring::Viterbi>(const Line&, SCellPtr) const;
+template Status SCell::Scan<semiring::Prefix>(const Line&, SCellPtr) const;
+template Status SCell::Complete<semiring::Full>(const SGrammar&, const Chart&);
+template Status SCell::Complete<semiring::Viterbi>(const SGrammar&, const Chart&);
+template Status SCell::Complete<semiring::Prefix>(const SGrammar&, const Chart&);
@@ -29,8 +29,12 @@
 #define __SCELL_HPP
 
 #include "Common.h"
+#include "Arena.impl.h"
+#include "Array.impl.h"
+#include "HashMap.impl.h"
 #include "SState.impl.h"
-#include <set>
+#include <functional>
+#include <vector>
 
 namespace sartparser
 {
@@ -41,33 +45,110 @@ namespace impl
 struct TokenSorter:
         public std::binary_function<const Token&, const Token&, bool>
 {
-    bool operator()(const Token& a, const Token& b)
+    bool operator()(const Token& a, const Token& b) const
     {
         return a.GetName() < b.GetName();
     }
 };
 
-typedef std::set<Token, TokenSorter> Line;
+// Tokens of a Line must be interned (copies of grammar terminals, see
+// Token::GetId()), they are matched to the states by id. They are sorted by
+// name (see TokenSorter) and no two have the same name. A vector rather than
+// a set so that a line reused from step to step allocates nothing.
+typedef std::vector<Token> Line;
+
+// Scratch space of SCell::Predict(), kept by the parser so that predicting
+// a step allocates nothing once it has grown to the size of the grammar
+struct PredictBuffers
+{
+    // Total alpha of the states waiting on each nonterminal Z, and the
+    // nonterminals in the order they were first seen
+    std::vector<Real> ZAlpha;
+    std::vector<bool> ZSeen;
+    std::vector<size_t> ZOrder;
+
+    // Same for the nonterminals C predicted from them
+    std::vector<Real> CAlpha;
+    std::vector<bool> CSeen;
+    std::vector<size_t> COrder;
+};
 
 class SCell
 {
 public:
     typedef SState StateType;
 
-    SCell(bool partial = false);
+    // Map from the address of a state (see GetKey()) to another state
+    typedef HashMap<size_t, SStatePtr> StateMap;
+    static size_t GetKey(KSStatePtr pS);
+
+    SCell();
     virtual ~SCell();
 
-    void Init(SGrammar &g);
     void Init(const SGrammar &g);
 
-    Status Predict(const SGrammar &G);
-    SCellPtr Scan(const Line& tokens);
-    Status Complete(const SGrammar& sg);
+    // The steps of the parse compute only what the Semiring needs (see
+    // SemiringTraits), all the cells of a chart must use the same one
+    template<typename Semiring>
+    Status Predict(const SGrammar &G, PredictBuffers& buffers);
+    // Scans tokens into pCell, an empty cell (not added to any chart yet)
+    // whose beam, children and scaling settings are those of the step (see
+    // SetBeam(), SetKeepChildren() and SetScaling()). This cell is only read
+    // from.
+    template<typename Semiring>
+    Status Scan(const Line& tokens, SCellPtr pCell) const;
+    template<typename Semiring>
+    Status Complete(const SGrammar& sg, const Chart& chart);
     Real Filter(const SGrammar &G, SStatePtr pNewS, SStatePtr pS);
     bool Prune(SStatePtr pS);
 
-    void SetPartial (bool partial);
-    bool GetPartial () const;
+    // Beam used to prune the states of this cell (NULL, the default,
+    // disables pruning). Not owned.
+    void SetBeam(const Beam* beam);
+    // Number of states dropped by the beam in this cell
+    size_t GetPrunedCount() const;
+
+    // Whether completed states record their children (the backpointers
+    // used to build the Viterbi parse). On by default.
+    void SetKeepChildren(bool keep);
+
+    // Scaled-forward mode, set on the cells before they are scanned into.
+    // Each scanned cell divides the alpha and gamma of its scanned states by
+    // their total alpha, so values stay close to 1 however long the input.
+    // The alpha of a state is then GetAlpha() * exp(GetLogScale()) and its
+    // gamma GetGamma() * exp(GetLogScale() - logScale of cell K); the log
+    // scale is the sum of the logs of all the normalizers so far.
+    void SetScaling(bool scaling);
+    Real GetLogScale() const;
+
+    // Returns a copy of this cell holding only the states in keep, in the
+    // same order, and maps each of them to its copy in keep. The copy can
+    // still be completed from but no states can be added to it. The
+    // children of the copies are those of the originals until Relink().
+    SCellPtr Compact(StateMap& keep) const;
+
+    // Rebuilds the children of every state, replacing the ones found in
+    // moved by their copies (or dropping all of them if !keepChildren)
+    void Relink(const StateMap& moved, bool keepChildren);
+
+    // Returns a copy of this cell with all of its states (see Compact()),
+    // children in this cell are relinked to their copies
+    SCellPtr Copy() const;
+
+    // Number of charts holding this cell (see Chart), a cell held by more
+    // than one is shared and must not be modified. Release() returns the
+    // number of holders left, the last one deletes the cell.
+    void AddRef();
+    size_t Release();
+    bool IsShared() const;
+
+    // Makes the cell immutable and owned elsewhere, so it can be held by
+    // charts in any thread: it is always shared and never released
+    void Freeze();
+
+    // Empties the cell back to how it was built, keeping the memory of its
+    // states and indices for the next ones. The cell must not be shared.
+    void Recycle();
 
     Real GetHigh () const;
     void  SetHigh (Real high);
@@ -76,9 +157,18 @@ public:
     void  SetI(size_t index);
 
     SStatePtr MakeNewState();
+    // Recycles a state from MakeNewState() that was never added to the cell
+    void FreeState(SStatePtr pState);
+
+    // Tokens scanned to reach this cell (empty for the first cell)
+    const Line& GetScanned() const;
+
+    // First of the states waiting on pT (see SState::GetNextWaiting())
+    SStatePtr GetWaiting(KTokenPtr pT) const;
 
     size_t GetStateCount() const;
     KSStatePtr GetState(size_t i) const;
+    template<typename Semiring>
     Status AddState(
             SStatePtr pState,
             bool AddAlpha = false,
@@ -86,19 +176,71 @@ public:
             bool Sorted = false);
 
 private:
-    Status Scan(const Token &pT, SCellPtr pCell);
+    // States waiting on a symbol, chained through SState::GetNextWaiting()
+    // in the order they were added
+    struct WaitList
+    {
+        WaitList() : head(NULL), tail(NULL) {}
+
+        SStatePtr head;
+        SStatePtr tail;
+    };
+
+    template<typename Semiring>
+    Status Scan(const Token &pT, SCellPtr pCell) const;
+
+    // Drops the states below the beam once all the states of a step are in,
+    // when the best alpha is known
+    void ApplyBeam();
+    bool IsPrunable(KSStatePtr pS) const;
+    // Absolute threshold of the beam in the units of the alphas stored
+    Real GetThreshold() const;
 
+    // Normalizes the scanned states (see SetScaling())
+    void Rescale();
+
+    void AddWaiting(SStatePtr pState);
 
     Array<StateType> States;
 
-    SCellPtr NextCell;
-    SCellPtr PrevCell;
+    // Storage for all the states made by this cell, they are all released
+    // together when the cell is destroyed
+    Arena<StateType> StatePool;
+
+    // Storage for the child links of the states made by this cell
+    SChildPool ChildPool;
+
+    // Scanned tokens, the probabilities and marks of the input live here
+    // rather than in the states
+    Line Scanned;
+
+    // Index of States by SState::GetHash() to find duplicates quickly,
+    // states sharing a hash are chained through SState::GetNextInBucket()
+    HashMap<size_t, SStatePtr> StateIndex;
+
+    // Index of unfinished States by the id of the symbol after the dot,
+    // nonterminals (for completion) and terminals (for scanning)
+    HashMap<size_t, WaitList> WaitingN;
+    HashMap<size_t, WaitList> WaitingT;
+
     size_t I;
 
-    bool partial_;
     Real highMark_;
     bool highMarkSet_;
 
+    bool keepChildren_;
+
+    bool scaling_;
+    Real logScale_;
+
+    const Beam* beam_;
+    // Highest alpha accepted by Prune() so far
+    Real bestAlpha_;
+    size_t pruned_;
+
+    size_t refs_;
+    bool frozen_;
+
     friend class CellUtils;
 };
 
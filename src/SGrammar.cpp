@@ -54,18 +54,65 @@ Status SGrammar::CheckGrammar()
 
    Status nRetCode = Grammar::CheckGrammar();
 
+   if (nRetCode == OK)
+      nRetCode = CheckProbabilities();
+
+   if (nRetCode != OK)
+      return nRetCode;
+
+   nRetCode = ComputeClosures();
+   if (nRetCode != OK)
+       return nRetCode;
+
+   return OK;
+}
+
+Status SGrammar::CheckGrammar(
+        const SparseMatrix& pl,
+        const SparseMatrix& rl,
+        const SparseMatrix& pu,
+        const SparseMatrix& ru)
+{
+   Status nRetCode = Grammar::CheckGrammar();
+
+   if (nRetCode == OK)
+      nRetCode = CheckProbabilities();
+
    if (nRetCode != OK)
       return nRetCode;
 
+   Eigen::Index size = static_cast<Eigen::Index>( N.GetCount() );
+   const SparseMatrix* closures[] = {&pl, &rl, &pu, &ru};
+   for(size_t i = 0; i < 4; i++)
+   {
+       if( closures[i]->rows() != size || closures[i]->cols() != size )
+       {
+           std::cerr << "ERROR: Closure matrices do not match the grammar"
+                     << std::endl;
+           return ERR_INVPARAM;
+       }
+   }
+
+   Pl = pl;
+   Rl = rl;
+   Pu = pu;
+   Ru = ru;
+   RuT = SparseMatrix( Ru.transpose() );
+
+   return OK;
+}
+
+Status SGrammar::CheckProbabilities() const
+{
    // Check that sum of probabilities of rules for
    // each nonterminal adds up to 1.0
    for(unsigned int i = 0; i < P.GetCount(); i++)
    {
        Real prob = 0.0;
-       ProductionPtr pP = P.Get(i);
+       KProductionPtr pP = P.Get(i);
        for(size_t j = 0; j < pP->GetRuleCount(); j++)
        {
-           RulePtr pR = pP->GetRule(j);
+           KSRulePtr pR = pP->GetRule(j);
            prob += pR->GetProb();
        }
 
@@ -77,10 +124,6 @@ Status SGrammar::CheckGrammar()
        }
    }
 
-   nRetCode = ComputeClosures();
-   if (nRetCode != OK)
-       return nRetCode;
-
    return OK;
 }
 
@@ -90,13 +133,9 @@ Status SGrammar::ComputeClosures()
    int size = N.GetCount();
    size_t PCount = P.GetCount();
 
-   // It assumes all the matrices have been allocated.
-   // Clear the matrix
-
-   // Create a matrix of zeros of the right size
-   Matrix zeros = Matrix::Zero(size, size);
-   Pl = zeros;
-   Pu = zeros;
+   // Nonzero entries of Pl and Pu, repeated entries are added up
+   typedef Eigen::Triplet<Real> Entry;
+   std::vector<Entry> PlEntries, PuEntries;
 
    for(size_t i = 0; i < PCount; i++)
    {
@@ -132,16 +171,21 @@ Status SGrammar::ComputeClosures()
                // Pl accumulates probability for all left corner
                // relations between LHS and each one of the first
                // nonterminals of each RHS.
-               Pl(LHSIndex, Index) += Pr;
+               PlEntries.push_back( Entry(LHSIndex, Index, Pr) );
 
                // Check if it is a unit production.
                // If it is then it is a part of Pu.
                if( !pTI.GetNext() )
-                   Pu(LHSIndex, Index) += Pr;
+                   PuEntries.push_back( Entry(LHSIndex, Index, Pr) );
            }
        }
    }
 
+   Pl.resize(size, size);
+   Pl.setFromTriplets(PlEntries.begin(), PlEntries.end());
+   Pu.resize(size, size);
+   Pu.setFromTriplets(PuEntries.begin(), PuEntries.end());
+
    // Rl, as a matrix of transitive reflexive closures of the
    // corresponding Pl can be computed in closed form as 
    // Rl = (I - Pl)^-1
@@ -151,15 +195,220 @@ Status SGrammar::ComputeClosures()
    // corresponding Pu can be computed in closed form as 
    // Ru = (I - Pu)^-1
    MakeR(Pu, Ru);
+   RuT = SparseMatrix( Ru.transpose() );
 
    return OK;
 }
 
-void SGrammar::MakeR(const Matrix &aP, Matrix &aR)
+void SGrammar::MakeR(const SparseMatrix &aP, SparseMatrix &aR) const
 {
-   int size = N.GetCount();
-   Matrix identity = Matrix::Identity(size, size);
+   // aR = (I - aP)^-1, i.e. aR = I + aP * aR. Rows of aR can only be nonzero
+   // for the nonterminals reachable in the graph of aP, so instead of
+   // inverting the whole matrix it is solved one strongly connected
+   // component S at a time:
+   //    aR(S,:) = (I - aP(S,S))^-1 * ( I(S,:) + aP(S,~S) * aR(~S,:) )
+   // Components come in reverse topological order, so the rows of aR for
+   // the successors of S (~S) are always known when S is solved.
+   size_t size = N.GetCount();
+
+   Components components;
+   FindComponents(aP, components);
+
+   typedef std::vector< std::pair<size_t, Real> > Row;
+   std::vector<Row> rows(size);
+
+   // Dense scratch row, with the list of its nonzero positions
+   std::vector<Real> acc(size, 0.0);
+   std::vector<bool> used(size, false);
+   std::vector<size_t> touched;
 
-   // aR = (I - aP)^-1
-   aR = (identity - aP).inverse();
+   std::vector<int> local(size, -1);
+
+   for(size_t c = 0; c < components.size(); c++)
+   {
+      const std::vector<size_t>& S = components[c];
+      size_t k = S.size();
+      Eigen::Index n = static_cast<Eigen::Index>(k);
+
+      for(size_t i = 0; i < k; i++)
+         local[ S[i] ] = static_cast<int>(i);
+
+      // (I - aP(S,S))^-1
+      Matrix A = Matrix::Identity(n, n);
+      for(size_t i = 0; i < k; i++)
+      {
+         Eigen::Index row = static_cast<Eigen::Index>(S[i]);
+         for(SparseMatrix::InnerIterator it(aP, row); it; ++it)
+         {
+            int j = local[ static_cast<size_t>( it.col() ) ];
+            if( j >= 0 )
+               A(static_cast<Eigen::Index>(i), j) -= it.value();
+         }
+      }
+      if( k > 1 || A(0,0) != 1.0 )
+         A = A.inverse().eval();
+
+      // I(S,:) + aP(S,~S) * aR(~S,:), one row per member of S
+      std::vector<Row> B(k);
+      for(size_t i = 0; i < k; i++)
+      {
+         Eigen::Index row = static_cast<Eigen::Index>(S[i]);
+         for(SparseMatrix::InnerIterator it(aP, row); it; ++it)
+         {
+            size_t col = static_cast<size_t>( it.col() );
+            if( local[col] >= 0 )
+               continue;
+
+            const Row& R = rows[col];
+            for(Row::const_iterator r = R.begin(); r != R.end(); ++r)
+            {
+               if( !used[r->first] )
+               {
+                  used[r->first] = true;
+                  touched.push_back(r->first);
+               }
+               acc[r->first] += it.value() * r->second;
+            }
+         }
+
+         B[i].push_back( std::make_pair(S[i], 1.0) );
+         for(size_t t = 0; t < touched.size(); t++)
+         {
+            B[i].push_back( std::make_pair(touched[t], acc[ touched[t] ]) );
+            acc[ touched[t] ] = 0.0;
+            used[ touched[t] ] = false;
+         }
+         touched.clear();
+      }
+
+      // aR(S,:) = A * B
+      for(size_t i = 0; i < k; i++)
+      {
+         for(size_t j = 0; j < k; j++)
+         {
+            Real a = A( static_cast<Eigen::Index>(i),
+                       static_cast<Eigen::Index>(j) );
+            if( a == 0.0 )
+               continue;
+
+            for(Row::const_iterator r = B[j].begin(); r != B[j].end(); ++r)
+            {
+               if( !used[r->first] )
+               {
+                  used[r->first] = true;
+                  touched.push_back(r->first);
+               }
+               acc[r->first] += a * r->second;
+            }
+         }
+
+         Row& R = rows[ S[i] ];
+         for(size_t t = 0; t < touched.size(); t++)
+         {
+            if( acc[ touched[t] ] != 0.0 )
+               R.push_back( std::make_pair(touched[t], acc[ touched[t] ]) );
+            acc[ touched[t] ] = 0.0;
+            used[ touched[t] ] = false;
+         }
+         touched.clear();
+      }
+
+      for(size_t i = 0; i < k; i++)
+         local[ S[i] ] = -1;
+   }
+
+   typedef Eigen::Triplet<Real> Entry;
+   std::vector<Entry> entries;
+   for(size_t i = 0; i < size; i++)
+   {
+      for(Row::const_iterator r = rows[i].begin(); r != rows[i].end(); ++r)
+         entries.push_back( Entry( static_cast<int>(i),
+                                   static_cast<int>(r->first), r->second ) );
+   }
+
+   aR.resize( static_cast<int>(size), static_cast<int>(size) );
+   aR.setFromTriplets(entries.begin(), entries.end());
+}
+
+void SGrammar::FindComponents(
+        const SparseMatrix &aP,
+        Components &components) const
+{
+   // Tarjan's algorithm (iterative), components are found in reverse
+   // topological order
+   size_t size = N.GetCount();
+   const size_t UNSEEN = static_cast<size_t>(-1);
+
+   std::vector<size_t> index(size, UNSEEN);
+   std::vector<size_t> lowLink(size, 0);
+   std::vector<bool> onStack(size, false);
+   std::vector<size_t> stack;
+
+   // Depth first search: node and its next successor to visit
+   std::vector< std::pair<size_t, SparseMatrix::InnerIterator> > path;
+   size_t counter = 0;
+
+   components.clear();
+
+   for(size_t root = 0; root < size; root++)
+   {
+      if( index[root] != UNSEEN )
+         continue;
+
+      index[root] = lowLink[root] = counter++;
+      stack.push_back(root);
+      onStack[root] = true;
+      path.push_back( std::make_pair(root,
+                      SparseMatrix::InnerIterator(aP,
+                              static_cast<Eigen::Index>(root))) );
+
+      while( !path.empty() )
+      {
+         size_t v = path.back().first;
+         SparseMatrix::InnerIterator& it = path.back().second;
+
+         if( it )
+         {
+            size_t w = static_cast<size_t>( it.col() );
+            ++it;
+
+            if( index[w] == UNSEEN )
+            {
+               index[w] = lowLink[w] = counter++;
+               stack.push_back(w);
+               onStack[w] = true;
+               path.push_back( std::make_pair(w,
+                               SparseMatrix::InnerIterator(aP,
+                               static_cast<Eigen::Index>(w))) );
+            }
+            else if( onStack[w] && index[w] < lowLink[v] )
+            {
+               lowLink[v] = index[w];
+            }
+            continue;
+         }
+
+         // All successors of v visited
+         path.pop_back();
+         if( !path.empty() )
+         {
+            size_t u = path.back().first;
+            if( lowLink[v] < lowLink[u] )
+               lowLink[u] = lowLink[v];
+         }
+
+         if( lowLink[v] == index[v] )
+         {
+            components.push_back( std::vector<size_t>() );
+            size_t w;
+            do
+            {
+               w = stack.back();
+               stack.pop_back();
+               onStack[w] = false;
+               components.back().push_back(w);
+            } while( w != v );
+         }
+      }
+   }
 }
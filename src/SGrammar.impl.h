@@ -32,6 +32,7 @@
 #include "Grammar.impl.h"
 #include "SRule.impl.h"
 #include <Eigen/LU>
+#include <Eigen/Sparse>
 
 namespace sartparser
 {
@@ -42,8 +43,9 @@ namespace impl
 class SGrammar : public Grammar
 {
    public:
-      SGrammar() : Grammar()
-         {partial_ = false;}
+      typedef Eigen::SparseMatrix<Real, Eigen::RowMajor> SparseMatrix;
+
+      SGrammar() : Grammar() {}
       virtual ~SGrammar() {}
 
       Status AddRule(
@@ -53,26 +55,44 @@ class SGrammar : public Grammar
               const std::string& label = "");
 
       virtual Status CheckGrammar();
-              Real GetPl(int i, int j) const {return Pl(i,j);}
-              Real GetPu(int i, int j) const {return Pu(i,j);}
-              Real GetRl(int i, int j) const {return Rl(i,j);}
-              Real GetRu(int i, int j) const {return Ru(i,j);}
 
-      void SetPartial(bool partial){partial_ = partial;}
-      bool GetPartial() const { return partial_; }
+      // Same checks as CheckGrammar(), but the closure matrices are the ones
+      // given (e.g. from a grammar image) rather than computed here
+      Status CheckGrammar(
+              const SparseMatrix& pl,
+              const SparseMatrix& rl,
+              const SparseMatrix& pu,
+              const SparseMatrix& ru);
+              Real GetPl(int i, int j) const {return Pl.coeff(i,j);}
+              Real GetPu(int i, int j) const {return Pu.coeff(i,j);}
+              Real GetRl(int i, int j) const {return Rl.coeff(i,j);}
+              Real GetRu(int i, int j) const {return Ru.coeff(i,j);}
+
+              // Row i of Rl holds the left corners of i
+              const SparseMatrix& GetRlMatrix() const {return Rl;}
+              const SparseMatrix& GetPlMatrix() const {return Pl;}
+              const SparseMatrix& GetPuMatrix() const {return Pu;}
+              const SparseMatrix& GetRuMatrix() const {return Ru;}
+
+              // Transpose of Ru: row j holds the nonterminals i (columns)
+              // that reach j through unit productions, with Ru(i,j)
+              const SparseMatrix& GetRuT() const {return RuT;}
    private:
       typedef Eigen::Matrix<Real, Eigen::Dynamic, Eigen::Dynamic> Matrix;
+      typedef std::vector< std::vector<size_t> > Components;
+      Status CheckProbabilities() const;
       Status ComputeClosures();
 
-      void MakeR(const Matrix &aP, Matrix &aR);
-      
+      void MakeR(const SparseMatrix &aP, SparseMatrix &aR) const;
+      void FindComponents(const SparseMatrix &aP, Components &components) const;
+
       // Left corner, left corner closure, 
       // unit production and unit production closure 
       // matrices. Their size is N.GetCount() x N.GetCount()
-      Matrix Pl, Rl, Pu, Ru;
-      
-   private:
-      bool partial_;
+      SparseMatrix Pl, Rl, Pu, Ru;
+
+      // Transpose of Ru used by completion
+      SparseMatrix RuT;
 };
 
 
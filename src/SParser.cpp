@@ -26,16 +26,25 @@
  */
 
 
+#include <algorithm>
 #include <cmath>
 #include <stdexcept>
-#include <map>
+
+#ifdef USE_CXX11
+#include <atomic>
+#include <functional>
+#include <system_error>
+#include <thread>
+#endif
 
 #include "SParser.h"
 #include "PTerminal.h"
 #include "SParserUtils.impl.h"
 #include "CellUtils.impl.h"
+#include "Chart.impl.h"
 #include "SCell.impl.h"
 #include "CFGrammar.impl.h"
+#include "Semiring.impl.h"
 
 
 using namespace sartparser;
@@ -45,137 +54,267 @@ using namespace impl;
 //==============================================================================
 // IMPL DEFINITION
 //==============================================================================
-struct SParser::Impl
+template<typename Semiring>
+struct BasicSParser<Semiring>::Impl
 {
-    Impl(CFGrammar &cfg, bool partial);
+    typedef SemiringTraits<Semiring> Traits;
+
+    // Predicts the initial states unless given head, a frozen cell holding
+    // them already
+    Impl(const CFGrammar &cfg, bool keepTrees, SCellPtr head = NULL);
+    // Copies share all the cells of the chart (see SParser::fork())
+    Impl(const Impl& other);
     ~Impl();
 
-    Status ParseFinal();
-    std::pair<SCellPtr, KSStatePtr> GetMostLikelyFinalState();
+    void UpdateFinalState();
     void ExpandState(const SState &pS, StringVector& terminals) const;
+    void ExpandSettled(
+            const SState& s,
+            size_t end,
+            size_t to,
+            SettledParse& settled) const;
+    ParseTree TreeFromState(const SState& s, size_t end) const;
 
-    SCellPtr backtrack();
     ParseProbability GetViterbiProb(const SState &state) const;
-    Status ParseLine(const Line &line, bool final = false);
-    Line getPredictedLine() const;
-    ParseProbability getPredictedAlpha(const Line& line);
+    Status ParseLine(const Line &line);
+    void TerminalAlphas(std::vector<Real>& totalAlphas) const;
+    ParseProbability NextStepProb(Real alpha) const;
+    Prediction PredictNext() const;
+    void PrefixProbs(ParseProbabilities& result) const;
 
     static ParseProbability getMaxAlpha(const SCell &cell);
 
     const CFGrammar& grammarWrapper_;
     const SGrammar& grammar_;
-    SCell cellHead_;
 
-    // This is to keep track
-    // of current cell in the list
-    SCellPtr currentCell_;
-    bool partial_;
+    // All the cells of the parse so far, the current one is the last. The
+    // first one holds the initial states and is never changed, it may be
+    // shared with other parsers (see CompiledGrammar). Cells released go to
+    // the pool of the chart, see SParser::setPoolLimit().
+    Chart chart_;
+
+    // Reused from step to step, so that parsing allocates nothing once the
+    // pool of the chart has warmed up
+    Line line_;
+    PredictBuffers buffers_;
+
+    // Beam shared by all the cells of the chart
+    Beam beam_;
+    // States pruned by the steps parsed so far
+    size_t pruned_;
+
+    // Most likely state to finish the parse with in the last cell, and the
+    // Viterbi parse it yields once asked for, until the next step
+    KSStatePtr finalState_;
+    bool viterbiCached_;
+    ViterbiParse viterbi_;
+
+    // Whether backpointers are kept at all, see SParser::SParser()
+    const bool trees_;
+
+    // Streaming mode, see SParser::setStreaming(). The chart is compacted
+    // once the states added since the last time outnumber those it kept,
+    // so the cost of compacting is constant per state.
+    void Compact();
+    bool streaming_;
+    bool keepTrees_;
+    size_t keptStates_;
+    size_t newStates_;
+    const static size_t MIN_COMPACT_STATES = 4096;
+
+    // Scaled-forward mode, see SParser::setScaling()
+    bool scaling_;
+    // Log scale of every cell so far, kept to unscale the parse trees
+    std::vector<Real> logScales_;
+
+    // Fixed-lag decoding, see SParser::getSettledParse(). The terminals
+    // before position settled_ have been settled already.
+    size_t lag_;
+    size_t settled_;
 
     // Output stream to send debug information
     std::ostream* debug_;
 };
 
 //==============================================================================
-// IMPL IMPLEMENTATION
+// BATCH PARSING
 //==============================================================================
-SParser::Impl::Impl(CFGrammar& cfg, bool partial)
-    : grammarWrapper_( cfg )
-    , grammar_( cfg.pimpl_->sg )
-    , currentCell_( &cellHead_ )
-    , partial_( partial )
-    , debug_( NULL )
+namespace
 {
 
-    if (cfg.checkGrammar() != OK)
-        throw std::invalid_argument("Grammar check failed");
-
-    cellHead_.SetPartial(partial_);
+// Hands out the indices of the sequences of a batch to its workers, in input
+// order
+class BatchQueue
+{
+public:
+    explicit BatchQueue(size_t count)
+        : next_(0)
+        , count_(count)
+    {
+    }
 
-    //Note this call may modify sg (and consequently grammar_) !!!
-    cellHead_.Init(cfg.pimpl_->sg);
+    bool Next(size_t& index)
+    {
+        index = next_++;
+        return index < count_;
+    }
 
-    if ( cellHead_.Predict(grammar_) != OK)
-        throw std::invalid_argument(
-                "SParser failed to initialise (likely due to invalid grammar");
+private:
+    //Forbid copying
+    BatchQueue(const BatchQueue&);
+    BatchQueue& operator=(const BatchQueue&);
+
+#ifdef USE_CXX11
+    std::atomic<size_t> next_;
+#else
+    size_t next_;
+#endif
+    const size_t count_;
+};
 
-}
+// Parses sequences from queue until there are none left, reusing a single
+// parser (and so the memory of its steps) for all of them
+template<typename Semiring>
+void parseBatchWorker(
+        const CompiledGrammar& grammar,
+        bool keepTrees,
+        const PSequences& sequences,
+        BatchResults& results,
+        BatchQueue& queue)
+{
+    BasicSParser<Semiring> parser(grammar, keepTrees);
 
+    size_t i;
+    while ( queue.Next(i) )
+    {
+        parser.reset();
 
-SParser::Impl::~Impl()
-{
-    CellUtils::destroyCells(&cellHead_, false);
+        BatchResult& result = results[i];
+        result.status = parser.parse( sequences[i] );
+        result.viterbiParse = parser.getViterbiParse();
+        result.maxAlpha = parser.getCurrentMaxAlpha();
+    }
 }
 
+}
 
-Status SParser::Impl::ParseFinal()
+//==============================================================================
+// IMPL IMPLEMENTATION
+//==============================================================================
+template<typename Semiring>
+BasicSParser<Semiring>::Impl::Impl(
+        const CFGrammar& cfg,
+        bool keepTrees,
+        SCellPtr head)
+    : grammarWrapper_( cfg )
+    , grammar_( cfg.pimpl_->sg )
+    , chart_( (head) ? head : new SCell() )
+    , line_()
+    , buffers_()
+    , beam_()
+    , pruned_( 0 )
+    , finalState_( NULL )
+    , viterbiCached_( false )
+    , viterbi_()
+    , trees_( Traits::VITERBI && keepTrees )
+    , streaming_( false )
+    , keepTrees_( trees_ )
+    , keptStates_( 0 )
+    , newStates_( 0 )
+    , scaling_( false )
+    , logScales_( 1, 0.0 )
+    , lag_( 0 )
+    , settled_( 0 )
+    , debug_( NULL )
 {
-    if(debug_)
+    // The beam is not enabled yet and predicted states have no children, so
+    // the initial states are the same for any parser settings
+    if ( !head )
     {
-        *debug_ << "Parsing final symbol" << std::endl;
-    }
+        head = chart_.Get(0);
+        head->Init(grammar_);
 
-    Line final;
-    final.insert( *grammar_.GetTerminal("") );
+        if ( head->Predict<Semiring>(grammar_, buffers_) != OK)
+            throw std::invalid_argument(
+                    "SParser failed to initialise (likely due to invalid grammar");
+    }
 
-    return ParseLine(final, true);
+    UpdateFinalState();
 }
 
 
-std::pair<SCellPtr, KSStatePtr> SParser::Impl::GetMostLikelyFinalState()
+template<typename Semiring>
+BasicSParser<Semiring>::Impl::Impl(const Impl& other)
+    : grammarWrapper_( other.grammarWrapper_ )
+    , grammar_( other.grammar_ )
+    , chart_( other.chart_ )
+    , line_()
+    , buffers_()
+    , beam_( other.beam_ )
+    , pruned_( other.pruned_ )
+    , finalState_( other.finalState_ )
+    , viterbiCached_( other.viterbiCached_ )
+    , viterbi_( other.viterbi_ )
+    , trees_( other.trees_ )
+    , streaming_( other.streaming_ )
+    , keepTrees_( other.keepTrees_ )
+    , keptStates_( other.keptStates_ )
+    , newStates_( other.newStates_ )
+    , scaling_( other.scaling_ )
+    , logScales_( other.logScales_ )
+    , lag_( other.lag_ )
+    , settled_( other.settled_ )
+    , debug_( other.debug_ )
 {
-    KSStatePtr state = NULL;
-    int maxIndex = -1;
-    Real maxProb = -1;
+}
 
-    // Parse the final symbol ("")
-    ParseFinal();
+template<typename Semiring>
+BasicSParser<Semiring>::Impl::~Impl()
+{
+}
 
-    // Now backtrack, but keep last cell for this function
-    SCellPtr finalCell = backtrack();
 
-    //if for whatever reason it's still invalid return NULL
-    if (!finalCell)
-    {
-        return std::make_pair<SCellPtr, KSStatePtr>(NULL, NULL);
-    }
+template<typename Semiring>
+void BasicSParser<Semiring>::Impl::UpdateFinalState()
+{
+    Real maxProb = -1;
+
+    finalState_ = NULL;
+    viterbiCached_ = false;
 
-    // Find the final state
-    for(size_t i = 0; i < finalCell->GetStateCount(); i++)
+    // The candidates are the states waiting on the final symbol (""), the
+    // ones parsing it would complete. Its probability is 1, so they already
+    // have the Viterbi probability of the parse they would finish.
+    KSCellPtr cell = chart_.GetLast();
+    KTokenPtr end = grammar_.GetEnd();
+    for(KSStatePtr state = cell->GetWaiting(end); state != NULL;
+        state = state->GetNextWaiting())
     {
-        state = finalCell->GetState(i);
-        if( state->GetLHS()->GetName() == "" )
+        if( state->GetLHS()->SameName( *end ) )
         {
-            int length = finalCell->GetI() - state->GetK() - 1;
+            int length = cell->GetI() - state->GetK();
             Real prob = state->GetV()/length;
-            if( state->GetV() != 0.0 && maxIndex == -1)
+            if( state->GetV() != 0.0 && finalState_ == NULL)
             {
                 maxProb = prob;
-                maxIndex = i;
+                finalState_ = state;
             }
             else
             {
                 if(maxProb < prob)
                 {
                     maxProb = prob;
-                    maxIndex = i;
+                    finalState_ = state;
                 }
             }
         }
     }
-
-    if(maxIndex == -1)
-    {
-        delete finalCell;
-        return std::make_pair<SCellPtr, KSStatePtr>(NULL, NULL);
-    }
-    else
-    {
-        state = finalCell->GetState( static_cast<size_t>(maxIndex) );
-        return std::make_pair(finalCell, state);
-    }
 }
 
-void SParser::Impl::ExpandState(const SState& s, StringVector& terminals) const
+template<typename Semiring>
+void BasicSParser<Semiring>::Impl::ExpandState(
+        const SState& s,
+        StringVector& terminals) const
 {
     size_t childIndex = 0;
     KTokItem tokItem = s.GetFirst();
@@ -183,9 +322,11 @@ void SParser::Impl::ExpandState(const SState& s, StringVector& terminals) const
     while( tokItem )
     {
         const Token& t = *tokItem.GetToken();
-        if (t.GetType() == Token::TERMINAL && t.GetName() != "" )
+        if (t.GetType() == Token::TERMINAL)
         {
-            terminals.push_back( t.GetName() );
+            // The end-of-string terminal ("") has no child and isn't output
+            if ( t.GetName() != "" )
+                terminals.push_back( t.GetName() );
         }
         else
         {
@@ -197,31 +338,98 @@ void SParser::Impl::ExpandState(const SState& s, StringVector& terminals) const
     }
 }
 
-SCellPtr SParser::Impl::backtrack()
+// Appends to settled the terminals of s (which ends at position end) from
+// settled.start up to to, and the largest subtrees of s spanning only them.
+// Only the children of s that end after settled.start are visited.
+template<typename Semiring>
+void BasicSParser<Semiring>::Impl::ExpandSettled(
+        const SState& s,
+        size_t end,
+        size_t to,
+        SettledParse& settled) const
 {
-    if ( currentCell_ != &cellHead_ )
+    // Walking the right hand side backwards, a terminal takes one step and
+    // a nonterminal the span of its child, which gives where each item ends
+    std::vector<KTokenPtr> rhs;
+    for( KTokItem tok = s.GetFirst(); tok; tok = tok.GetNext() )
+        rhs.push_back( tok.GetToken() );
+
+    std::vector<size_t> ends( rhs.size() );
+    size_t pos = end;
+    size_t childIndex = s.GetChildCount();
+    for( size_t i = rhs.size(); i-- > 0; )
     {
-        currentCell_ = CellUtils::getPrev(currentCell_);
-        return CellUtils::split(currentCell_);
+        ends[i] = pos;
+        if( rhs[i]->GetType() == Token::TERMINAL )
+            --pos;
+        else if( childIndex > 0 )
+            pos = s.GetChild(--childIndex)->GetK();
     }
-    else
+
+    childIndex = 0;
+    for( size_t i = 0; i < rhs.size(); ++i )
     {
-        return NULL;
+        if( rhs[i]->GetType() == Token::TERMINAL )
+        {
+            // The end-of-string terminal ("") isn't output
+            if ( ends[i] > settled.start && ends[i] <= to &&
+                 rhs[i]->GetName() != "" )
+                settled.terminals.push_back( rhs[i]->GetName() );
+            continue;
+        }
+
+        KSStatePtr pCh = s.GetChild( childIndex++ );
+        if( ends[i] <= settled.start || pCh->GetK() >= to )
+            continue;
+
+        if( pCh->GetK() >= settled.start && ends[i] <= to )
+        {
+            ExpandState( *pCh, settled.terminals );
+            settled.subtrees.push_back( TreeFromState( *pCh, ends[i] ) );
+        }
+        else
+            ExpandSettled( *pCh, ends[i], to, settled );
     }
 }
 
-Status SParser::Impl::ParseLine(const Line& line, bool final)
+template<typename Semiring>
+ParseTree BasicSParser<Semiring>::Impl::TreeFromState(
+        const SState& s,
+        size_t end) const
+{
+    if ( scaling_ )
+        return ParseTreeUtil::ParseTreeFromState(s, logScales_, end);
+    return ParseTreeUtil::ParseTreeFromState(s);
+}
+
+template<typename Semiring>
+void BasicSParser<Semiring>::Impl::Compact()
+{
+    newStates_ += chart_.GetLast()->GetStateCount();
+    if ( newStates_ < keptStates_ || newStates_ < MIN_COMPACT_STATES )
+        return;
+
+    keptStates_ = chart_.Compact(keepTrees_);
+    newStates_ = 0;
+
+    if ( debug_ )
+        *debug_ << "Compacted chart to " << keptStates_
+                << " states" << std::endl;
+}
+
+template<typename Semiring>
+Status BasicSParser<Semiring>::Impl::ParseLine(const Line& line)
 {
     Status retCode;
 
     //If first time, print headCell before modifications
-    if ( currentCell_ == &cellHead_ && debug_ && !final )
+    if ( chart_.GetCount() == 1 && debug_ )
     {
         *debug_ << "Initial states" << std::endl;
-        CellUtils::dumpCell(currentCell_, *debug_);
+        CellUtils::dumpCell(chart_.Get(0), *debug_);
     }
 
-    if(debug_ && !final)
+    if(debug_)
     {
         *debug_ << "Reading" << std::endl;
         for( Line::const_iterator it = line.begin(); it != line.end(); ++it )
@@ -231,105 +439,167 @@ Status SParser::Impl::ParseLine(const Line& line, bool final)
         *debug_ << std::endl;
     }
 
-    currentCell_ = currentCell_->Scan(line);
+    SCellPtr cell = chart_.NewCell();
+    cell->SetBeam(&beam_);
+    cell->SetKeepChildren(keepTrees_);
+    cell->SetScaling(scaling_);
 
-    if(currentCell_)
+    if( chart_.GetLast()->Scan<Semiring>(line, cell) == OK )
     {
-        retCode = currentCell_->Complete(grammar_);
+        retCode = chart_.Add(cell);
+        if( retCode != OK)
+        {
+            chart_.Discard(cell);
+            return retCode;
+        }
+
+        retCode = cell->Complete<Semiring>(grammar_, chart_);
         if( retCode == OK)
         {
-            retCode = currentCell_->Predict(grammar_);
+            retCode = cell->Predict<Semiring>(grammar_, buffers_);
         }
         if ( retCode != OK )
             return retCode;
 
+        if( debug_ && cell->GetPrunedCount() > 0 )
+            *debug_ << "Pruned " << cell->GetPrunedCount()
+                    << " states" << std::endl;
+
         if( debug_ )
-            CellUtils::dumpCell(currentCell_, *debug_);
+            CellUtils::dumpCell(cell, *debug_);
     }
     else
+    {
+        chart_.Discard(cell);
         return ERR_INVPARAM;
+    }
 
     return OK;
 }
 
-ParseProbability SParser::Impl::GetViterbiProb(const SState& state) const
+template<typename Semiring>
+ParseProbability BasicSParser<Semiring>::Impl::GetViterbiProb(const SState& state) const
 {
     // Note state came from the cell after the current one
-    int length = currentCell_->GetI() - state.GetK();
+    int length = chart_.GetLast()->GetI() - state.GetK();
 
     return ParseProbability( state.GetV(), length, true);
 }
 
 
-Line SParser::Impl::getPredictedLine() const
+// Total alpha of the states of the last cell waiting on each terminal, indexed
+// by terminal index. Scanning a terminal with probability one makes exactly
+// these states, so each total is the prefix probability of the input so far
+// followed by the terminal (End is left at 0).
+template<typename Semiring>
+void BasicSParser<Semiring>::Impl::TerminalAlphas(
+        std::vector<Real>& totalAlphas) const
 {
-    typedef std::map<std::string, Real> Storage;
-    typedef Storage::const_iterator Iterator;
+    KTokenPtr end = grammar_.GetEnd();
+    KSCellPtr current = chart_.GetLast();
 
-    Storage totalAlphas;
-
-    //Initialise maxAlphas (each terminal has a starting 0.0 probability)
-    for (size_t i = 0; i < grammar_.GetTCount(); ++i)
+    totalAlphas.assign( grammar_.GetTCount(), 0.0 );
+    for (size_t i = 0; i < totalAlphas.size(); ++i)
     {
-        const std::string& token = grammar_.GetTByIndex(i)->GetName();
-        if ( token != "" )
+        KTokenPtr tok = grammar_.GetTByIndex(i);
+        if ( tok->SameName(*end) )
+            continue;
+
+        for (KSStatePtr state = current->GetWaiting(tok); state != NULL;
+             state = state->GetNextWaiting())
         {
-            totalAlphas.insert( std::make_pair( token, 0.0 ) );
+            totalAlphas[i] += state->GetAlpha();
         }
     }
+}
 
+// Probability of an alpha of the next step, from the scale of the last cell
+template<typename Semiring>
+ParseProbability BasicSParser<Semiring>::Impl::NextStepProb(Real alpha) const
+{
+    KSCellPtr current = chart_.GetLast();
+    int length = current->GetI() + 1;
 
-    //Go through all states and note maxAlpha for each terminal
-    for (size_t i =0; i < currentCell_->GetStateCount(); ++i)
-    {
-        KSStatePtr state = currentCell_->GetState( i );
-        KTokenPtr tok = state->GetAfterDot().GetToken();
+    // Scaled-forward mode: the actual alpha is only representable as a log
+    Real logScale = current->GetLogScale();
+    if (logScale != 0.0 && alpha > 0.0)
+        return ParseProbability( std::log( alpha ) + logScale, length, true );
+    else
+        return ParseProbability( alpha, length, false );
+}
 
-        if ( !tok || tok->GetType() != Token::TERMINAL || tok->GetName() == "")
-        {
-            continue;
-        }
+// The distribution of the next terminal is the normalised total alpha of the
+// states of the last cell waiting on each terminal. The probability is the max
+// alpha of the states that would scan them and still be unfinished, were the
+// distribution the input of the next step. Both come from the scan index of
+// the last cell: the states the next step would complete or predict are not
+// made, and are not taken into account.
+template<typename Semiring>
+Prediction BasicSParser<Semiring>::Impl::PredictNext() const
+{
+    KSCellPtr current = chart_.GetLast();
 
-        totalAlphas.at( tok->GetName() ) += state->GetAlpha();
-    }
+    std::vector<Real> totalAlphas;
+    TerminalAlphas(totalAlphas);
 
-    //Get sum of all alphas
     Real sumAlphas = 0;
-    for (Iterator it = totalAlphas.begin(); it != totalAlphas.end(); ++it)
-    {
-        sumAlphas += it->second;
-    }
+    for (size_t i = 0; i < totalAlphas.size(); ++i)
+        sumAlphas += totalAlphas[i];
 
-    Line result;
-    for (Iterator it = totalAlphas.begin(); it != totalAlphas.end(); ++it)
+    Prediction result;
+    Real maxAlpha = -1;
+    for (size_t i = 0; i < totalAlphas.size(); ++i)
     {
-        const std::string& tokenName = it->first;
-        Real normAlpha = it->second/sumAlphas;
-        if (normAlpha > 0)
+        Real normAlpha = totalAlphas[i]/sumAlphas;
+        if ( !(normAlpha > 0) )
+            continue;
+
+        KTokenPtr tok = grammar_.GetTByIndex(i);
+        result.terminalDistribution.insert(
+                    std::make_pair(tok->GetName(), normAlpha) );
+
+        for (KSStatePtr state = current->GetWaiting(tok); state != NULL;
+             state = state->GetNextWaiting())
         {
-            result.insert( Token(tokenName, Token::TERMINAL, normAlpha ) );
+            // Skip the states scanning tok would finish
+            if ( !state->GetAfterDot().GetNext() )
+                continue;
+
+            Real alpha = state->GetAlpha() * normAlpha;
+            if ( alpha > maxAlpha )
+                maxAlpha = alpha;
         }
     }
 
-    return result;
+    if ( maxAlpha >= 0 )
+        result.probability = NextStepProb(maxAlpha);
 
+    return result;
 }
 
-ParseProbability SParser::Impl::getPredictedAlpha(const Line &line)
+template<typename Semiring>
+void BasicSParser<Semiring>::Impl::PrefixProbs(
+        ParseProbabilities& result) const
 {
-    //Parse predicted line
-    ParseLine(line);
+    KTokenPtr end = grammar_.GetEnd();
 
-    ParseProbability result = getMaxAlpha(*currentCell_);
+    std::vector<Real> totalAlphas;
+    TerminalAlphas(totalAlphas);
 
-    //Before returning ensure we delete predictedCell
-    SCellPtr predictedCell = backtrack();
-    delete predictedCell;
+    // Same order as CFGrammar::getTerminals(), which leaves End out
+    result.clear();
+    result.reserve( totalAlphas.size() );
+    for (size_t i = 0; i < totalAlphas.size(); ++i)
+    {
+        if ( grammar_.GetTByIndex(i)->SameName(*end) )
+            continue;
 
-    return result;
+        result.push_back( NextStepProb(totalAlphas[i]) );
+    }
 }
 
-ParseProbability SParser::Impl::getMaxAlpha(const SCell& cell)
+template<typename Semiring>
+ParseProbability BasicSParser<Semiring>::Impl::getMaxAlpha(const SCell& cell)
 {
 
     KSStatePtr maxAlphaState = NULL;
@@ -351,28 +621,59 @@ ParseProbability SParser::Impl::getMaxAlpha(const SCell& cell)
 
     if (maxAlphaState == NULL)
         return ParseProbability();
-    else
-        return ParseProbability( maxAlphaState->GetAlpha(), length, false );
+
+    // Scaled-forward mode: the actual alpha is only representable as a log
+    Real logScale = cell.GetLogScale();
+    if (logScale != 0.0)
+        return ParseProbability(
+                    std::log( maxAlphaState->GetAlpha() ) + logScale,
+                    length,
+                    true );
+
+    return ParseProbability( maxAlphaState->GetAlpha(), length, false );
 }
 
 //==============================================================================
 // SPARSER IMPLEMENTATION
 //==============================================================================
-SParser::SParser(CFGrammar &cfg)
+template<typename Semiring>
+BasicSParser<Semiring>::BasicSParser(CFGrammar &cfg, bool keepTrees)
+{
+    if (cfg.checkGrammar() != OK)
+        throw std::invalid_argument("Grammar check failed");
+
+    pimpl_ = new Impl( cfg, keepTrees );
+}
+
+template<typename Semiring>
+BasicSParser<Semiring>::BasicSParser(
+        const CompiledGrammar& grammar,
+        bool keepTrees)
+{
+    // Checked and predicted once and for all when it was compiled
+    pimpl_ = new Impl( grammar.grammar_, keepTrees,
+                       grammar.heads_[ Impl::Traits::INDEX ] );
+}
+
+template<typename Semiring>
+BasicSParser<Semiring>::BasicSParser(Impl* pimpl)
+    : pimpl_( pimpl )
 {
-    pimpl_ = new Impl( cfg, false );
 }
 
-SParser::~SParser()
+template<typename Semiring>
+BasicSParser<Semiring>::~BasicSParser()
 {
     delete pimpl_;
 }
 
-Status SParser::parse(const PInput &input)
+template<typename Semiring>
+Status BasicSParser<Semiring>::parse(const PInput &input)
 {
     typedef PInput::const_iterator Iterator;
 
-    Line line;
+    Line& line = pimpl_->line_;
+    line.clear();
 
     for( Iterator it = input.begin(); it != input.end(); ++it)
     {
@@ -388,18 +689,36 @@ Status SParser::parse(const PInput &input)
                     it->probability,
                     it->highMark,
                     it->lowMark);
+        newToken.SetId( tok->GetId() );
 
-        line.insert(newToken);
+        // Sorted by name, the first of several with the same name is kept
+        Line::iterator pos = std::lower_bound(
+                    line.begin(), line.end(), newToken, TokenSorter() );
+        if ( pos == line.end() || TokenSorter()(newToken, *pos) )
+            line.insert(pos, newToken);
     }
 
-    pimpl_->ParseLine(line);
+    if ( pimpl_->ParseLine(line) == OK )
+    {
+        pimpl_->pruned_ += pimpl_->chart_.GetLast()->GetPrunedCount();
+        if ( pimpl_->scaling_ && pimpl_->keepTrees_ )
+        {
+            pimpl_->logScales_.resize( pimpl_->chart_.GetCount(), 0.0 );
+            pimpl_->logScales_.back() =
+                    pimpl_->chart_.GetLast()->GetLogScale();
+        }
+        if ( pimpl_->streaming_ )
+            pimpl_->Compact();
+    }
+    pimpl_->UpdateFinalState();
 
     return OK;
 }
 
 
 
-Status SParser::parse(const PInputs &inputs)
+template<typename Semiring>
+Status BasicSParser<Semiring>::parse(const PInputs &inputs)
 {
     Status errCode = OK;
 
@@ -415,75 +734,257 @@ Status SParser::parse(const PInputs &inputs)
     return errCode;
 }
 
-void SParser::reset()
+template<typename Semiring>
+Status BasicSParser<Semiring>::parseBatch(
+        const CompiledGrammar& grammar,
+        const PSequences& sequences,
+        BatchResults& results,
+        size_t workers,
+        bool keepTrees)
 {
-    pimpl_->currentCell_ = &pimpl_->cellHead_;
-    CellUtils::destroyCells(pimpl_->currentCell_, false);
+    results.assign( sequences.size(), BatchResult() );
+    BatchQueue queue( sequences.size() );
+
+#ifdef USE_CXX11
+    if ( workers == 0 )
+        workers = std::thread::hardware_concurrency();
+    workers = std::min( workers, sequences.size() );
+
+    // The calling thread is a worker too
+    std::vector<std::thread> threads;
+    for (size_t w = 1; w < workers; ++w)
+    {
+        try
+        {
+            threads.push_back( std::thread(
+                        parseBatchWorker<Semiring>,
+                        std::cref(grammar),
+                        keepTrees,
+                        std::cref(sequences),
+                        std::ref(results),
+                        std::ref(queue) ) );
+        }
+        catch(const std::system_error&)
+        {
+            // Fewer workers, the sequences still all get parsed
+            break;
+        }
+    }
+
+    parseBatchWorker<Semiring>( grammar, keepTrees, sequences, results, queue );
+
+    for (size_t w = 0; w < threads.size(); ++w)
+        threads[w].join();
+#else
+    // Without threads the calling thread is the only worker
+    (void) workers;
+    parseBatchWorker<Semiring>( grammar, keepTrees, sequences, results, queue );
+#endif
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        if ( results[i].status != OK )
+            return results[i].status;
+    }
+    return OK;
 }
 
-ParseProbability SParser::getCurrentMaxAlpha() const
+template<typename Semiring>
+void BasicSParser<Semiring>::reset()
 {
-    return Impl::getMaxAlpha( *pimpl_->currentCell_ );
+    pimpl_->chart_.Truncate(1);
+    pimpl_->pruned_ = 0;
+    pimpl_->keptStates_ = 0;
+    pimpl_->newStates_ = 0;
+    pimpl_->logScales_.assign( 1, 0.0 );
+    pimpl_->settled_ = 0;
+    pimpl_->UpdateFinalState();
 }
 
-Prediction SParser::getPrediction()
+template<typename Semiring>
+ParseProbability BasicSParser<Semiring>::getCurrentMaxAlpha() const
 {
-    //Compute what we need
-    Line predicted = pimpl_->getPredictedLine();
+    // No alphas without the forward probabilities
+    if ( !Impl::Traits::FORWARD )
+        return ParseProbability();
 
-    ParseProbability predictedProb = pimpl_->getPredictedAlpha(predicted);
+    return Impl::getMaxAlpha( *pimpl_->chart_.GetLast() );
+}
 
-    Prediction result;
-    result.probability = predictedProb;
+template<typename Semiring>
+Prediction BasicSParser<Semiring>::getPrediction()
+{
+    if ( !Impl::Traits::FORWARD )
+        return Prediction();
 
-    //For each token in Line save its name and probability
-    typedef Line::const_iterator Iterator;
-    for (Iterator it = predicted.begin(); it != predicted.end(); ++it)
-    {
-        result.terminalDistribution.insert(
-                    std::make_pair(it->GetName(), it->GetProb() ) );
-    }
+    return pimpl_->PredictNext();
+}
+
+template<typename Semiring>
+ParseProbabilities BasicSParser<Semiring>::getPrefixProbabilities() const
+{
+    ParseProbabilities result;
+    if ( Impl::Traits::FORWARD )
+        pimpl_->PrefixProbs(result);
 
     return result;
 }
 
-ViterbiParse SParser::getViterbiParse()
+template<typename Semiring>
+ViterbiParse BasicSParser<Semiring>::getViterbiParse()
 {
-    std::pair<SCellPtr, KSStatePtr> pair = pimpl_->GetMostLikelyFinalState();
-    SCellPtr finalCell = pair.first;
-    const SState& mostLikelyState = *pair.second;
-    if (!finalCell)
-    {
+    // Neither Viterbi probabilities nor backpointers to build the parse from
+    if ( !Impl::Traits::VITERBI )
+        return ViterbiParse();
+
+    if ( pimpl_->viterbiCached_ )
+        return pimpl_->viterbi_;
+
+    if ( !pimpl_->finalState_ )
         return ViterbiParse();
+    const SState& mostLikelyState = *pimpl_->finalState_;
+
+    ViterbiParse& result = pimpl_->viterbi_;
+    result = ViterbiParse();
+    result.probability = pimpl_->GetViterbiProb(mostLikelyState);
+    pimpl_->viterbiCached_ = true;
+
+    // Without trees there is nothing to expand
+    if ( !pimpl_->keepTrees_ )
+        return result;
+
+    pimpl_->ExpandState(mostLikelyState, result.terminals);
+
+    // The final state ends after the final symbol
+    size_t end = pimpl_->chart_.GetLast()->GetI() + 1;
+    if ( pimpl_->scaling_ )
+    {
+        // Log scale of every cell, the final one (the same as the last)
+        // included
+        std::vector<Real> logScales( pimpl_->logScales_ );
+        logScales.resize( end, 0.0 );
+        logScales.push_back( pimpl_->chart_.GetLast()->GetLogScale() );
+
+        result.parseTree = ParseTreeUtil::ParseTreeFromState(
+                    mostLikelyState, logScales, end );
     }
+    else
+    {
+        result.parseTree = ParseTreeUtil::ParseTreeFromState(mostLikelyState);
+    }
+
+    return result;
+}
 
-    StringVector symbols;
-    pimpl_->ExpandState(mostLikelyState, symbols);
+template<typename Semiring>
+void BasicSParser<Semiring>::setLag(size_t lag)
+{
+    pimpl_->lag_ = lag;
+}
+
+template<typename Semiring>
+size_t BasicSParser<Semiring>::getLag() const
+{
+    return pimpl_->lag_;
+}
+
+template<typename Semiring>
+SettledParse BasicSParser<Semiring>::getSettledParse()
+{
+    SettledParse result;
+    result.start = pimpl_->settled_;
+
+    // Terminals parsed so far, the last lag_ of them may still change
+    size_t steps = pimpl_->chart_.GetCount() - 1;
+    if ( !pimpl_->keepTrees_ || steps <= pimpl_->settled_ + pimpl_->lag_ )
+        return result;
+    size_t to = steps - pimpl_->lag_;
 
-    //Prepare result
-    ViterbiParse result (
-                    symbols,
-                    pimpl_->GetViterbiProb(mostLikelyState),
-                    ParseTreeUtil::ParseTreeFromState(mostLikelyState) );
+    if ( !pimpl_->finalState_ )
+        return result;
+    const SState& mostLikelyState = *pimpl_->finalState_;
 
-    // We need to clear this memory just before leaving this function
-    // as it is the last time we'll use it
-    delete finalCell;
+    // The final state ends after the final symbol
+    size_t end = pimpl_->chart_.GetLast()->GetI() + 1;
+    result.probability = pimpl_->GetViterbiProb(mostLikelyState);
+    pimpl_->ExpandSettled(mostLikelyState, end, to, result);
+    pimpl_->settled_ = to;
 
     return result;
 }
 
-void SParser::setDebug(std::ostream& debug)
+template<typename Semiring>
+void BasicSParser<Semiring>::setBeam(const Beam& beam)
+{
+    pimpl_->beam_ = beam;
+}
+
+template<typename Semiring>
+const Beam& BasicSParser<Semiring>::getBeam() const
+{
+    return pimpl_->beam_;
+}
+
+template<typename Semiring>
+size_t BasicSParser<Semiring>::getPrunedCount() const
+{
+    return pimpl_->pruned_;
+}
+
+template<typename Semiring>
+void BasicSParser<Semiring>::setStreaming(bool streaming, bool keepTrees)
+{
+    reset();
+    pimpl_->streaming_ = streaming;
+    pimpl_->keepTrees_ = pimpl_->trees_ && (!streaming || keepTrees);
+}
+
+template<typename Semiring>
+void BasicSParser<Semiring>::setScaling(bool scaling)
+{
+    reset();
+    pimpl_->scaling_ = scaling;
+}
+
+template<typename Semiring>
+void BasicSParser<Semiring>::setPoolLimit(size_t limit)
+{
+    pimpl_->chart_.SetPoolLimit(limit);
+}
+
+template<typename Semiring>
+size_t BasicSParser<Semiring>::getPoolLimit() const
+{
+    return pimpl_->chart_.GetPoolLimit();
+}
+
+template<typename Semiring>
+BasicSParser<Semiring>* BasicSParser<Semiring>::fork() const
+{
+    return new BasicSParser( new Impl(*pimpl_) );
+}
+
+template<typename Semiring>
+void BasicSParser<Semiring>::setDebug(std::ostream& debug)
 {
     pimpl_->debug_ = &debug;
 }
 
-void SParser::unsetDebug()
+template<typename Semiring>
+void BasicSParser<Semiring>::unsetDebug()
 {
     pimpl_->debug_ = NULL;
 }
 
-const CFGrammar& SParser::getGrammar() const
+template<typename Semiring>
+const CFGrammar& BasicSParser<Semiring>::getGrammar() const
 {
     return pimpl_->grammarWrapper_;
 }
+
+//==============================================================================
+// SPARSER INSTANTIATIONS
+//==============================================================================
+template class sartparser::BasicSParser<semiring::Full>;
+template class sartparser::BasicSParser<semiring::Viterbi>;
+template class sartparser::BasicSParser<semiring::Prefix>;
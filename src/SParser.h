@@ -38,26 +38,61 @@
 namespace sartparser
 {
 
+/// @brief Semirings the parser can compute its results in.
+///
+/// Each semiring is a separate parser type (see BasicSParser), the quantities
+/// a semiring does not need are not computed at all.
+namespace semiring
+{
+/// @brief Forward and inner probabilities (alpha and gamma) and Viterbi
+/// parse. Everything is available.
+struct Full {};
+/// @brief Viterbi parse only (max-plus in log space). getCurrentMaxAlpha()
+/// and getPrediction() are not available and return empty results. Beams and
+/// scaling act on alphas, so they have no effect.
+struct Viterbi {};
+/// @brief Forward and inner probabilities only, without backpointers.
+/// getViterbiParse() is not available and returns an empty result.
+struct Prefix {};
+}
 
 /// @brief Class to perform stochastic grammar parsing.
 ///
 /// This class performs stochastic grammar parsing. SParser requires a CFGrammar
 /// in the constructor and a collection of PTerminals which represent concurrent
 /// terminal symbols and their probabilities.
-/// @note This class cannot be copied.
-class SParser
+/// @tparam Semiring What the parser computes, one of semiring::Full
+/// (SParser), semiring::Viterbi (ViterbiSParser) or semiring::Prefix
+/// (PrefixSParser).
+/// @note This class cannot be copied, see fork() instead.
+/// @remarks In *Python*, only SParser is available.
+template<typename Semiring>
+class BasicSParser
 {
 public:
     /// @brief Constructor
     /// @param cfg The Stochastic Grammar which to be used for parsing.
+    /// @param keepTrees If false, the parser keeps no backpointers at all
+    /// (forward-only mode), which saves memory and completion time. The
+    /// Viterbi parse is then not available: getViterbiParse() only reports
+    /// its probability, with no terminals and an empty parse tree.
     /// @throw std::invalid_argument If SCFGrammar::checkGrammar() fails.
     /// @note The grammar is passed by non-const reference and may be modified
     /// at any point. Users in multithreaded environments should be particularly
-    /// careful about this.
-    SParser(CFGrammar& cfg);
+    /// careful about this, and use a CompiledGrammar instead.
+    BasicSParser(CFGrammar& cfg, bool keepTrees = true);
+
+    /// @brief Constructor
+    /// @param grammar The checked grammar to be used for parsing. It is only
+    /// read from, so it can be shared by parsers on any number of threads.
+    /// It must outlive this parser. The initial states of the parse come
+    /// precomputed with it, so neither building nor resetting the parser
+    /// predicts them again.
+    /// @param keepTrees See BasicSParser(CFGrammar&, bool).
+    explicit BasicSParser(const CompiledGrammar& grammar, bool keepTrees = true);
 
     /// @brief Destructor
-    ~SParser();
+    ~BasicSParser();
 
     /// @brief Parse a terminal or set of concurrent terminals.
     /// @param input The probability of all grammar terminals for this parsing
@@ -77,10 +112,36 @@ public:
     /// @remarks This method is **not** available in *Python*.
     Status parse(const PInputs& inputs);
 
+    /// @brief Parse many independent sequences with the same grammar.
+    ///
+    /// The sequences are shared out among a number of workers, each of which
+    /// parses them one after another with a parser of its own (reset before
+    /// every sequence, see reset()). Workers are threads when the library is
+    /// built with C++11 support, otherwise the sequences are all parsed in
+    /// the calling thread.
+    /// @param grammar The grammar to parse the sequences with.
+    /// @param sequences The sequences to parse, each from the start.
+    /// @param results Set to the results of each sequence, in the same order
+    /// as sequences.
+    /// @param workers Number of workers (the calling thread is one of them),
+    /// by default one per hardware thread. No more workers than sequences
+    /// are used.
+    /// @param keepTrees See BasicSParser(CFGrammar&, bool).
+    /// @return sartparser::OK if all the sequences were parsed, the status of
+    /// the first sequence that failed otherwise (see BatchResult::status).
+    /// @remarks This method is **not** available in *Python*.
+    static Status parseBatch(
+            const CompiledGrammar& grammar,
+            const PSequences& sequences,
+            BatchResults& results,
+            size_t workers = 0,
+            bool keepTrees = true);
+
     /// @brief Reset this parser.
     ///
     /// Discard all information from previous parse() calls and start from
-    /// scratch.
+    /// scratch. The memory of the parsing steps discarded is kept for the
+    /// next ones (see setPoolLimit()).
     void reset();
 
     /// @brief Get the maximum alpha value of all candidate states
@@ -88,17 +149,132 @@ public:
     /// value.
     ParseProbability getCurrentMaxAlpha() const;
 
-    /// @brief Obtain the most likely next set of terminals, run a simulated
-    /// step with them and obtain maximum alpha value of simulated step.
+    /// @brief Obtain the most likely next set of terminals and the maximum
+    /// alpha value of the states that would scan them.
+    ///
+    /// Both are computed from the states of the current step waiting on each
+    /// terminal, no step is simulated. The states the predicted step would
+    /// complete or predict are therefore not accounted for in the max alpha.
     /// @returns The probaility distribution of terminals and the raw and
     /// normalised max alpha values of the predicted step.
     Prediction getPrediction();
 
+    /// @brief Obtain the prefix probability of the input so far followed by
+    /// each terminal.
+    ///
+    /// All of them are computed at once from the states of the current step
+    /// waiting on each terminal, no step is parsed.
+    /// @returns The raw and normalised probabilities, one per terminal, in the
+    /// order of CFGrammar::getTerminals(). Unavailable (always empty) if the
+    /// parser does not compute forward probabilities.
+    ParseProbabilities getPrefixProbabilities() const;
+
     /// @brief Obtain the Viterbi Parse (ie the most likely parse)
+    ///
+    /// The most likely state to finish the parse with is found as each step
+    /// is parsed, so this only builds the parse tree from it. The result is
+    /// cached until the next call to parse() or reset().
     /// @returns The viterbi parse, that is the sequence of terminals, the raw
     /// and scaled probability of the parse as well as the parse tree.
     ViterbiParse getViterbiParse();
 
+    /// @brief Set the lag of fixed-lag decoding (see getSettledParse()).
+    /// @param lag Number of parsing steps the Viterbi parse of a terminal
+    /// may still change for. By default 0: terminals are settled as soon as
+    /// they are parsed.
+    void setLag(size_t lag);
+
+    /// @brief Get the lag of fixed-lag decoding.
+    /// @returns The lag set with setLag().
+    size_t getLag() const;
+
+    /// @brief Obtain the part of the Viterbi parse settled since the last call
+    /// (fixed-lag decoding).
+    ///
+    /// The terminals parsed more than getLag() steps ago are taken from the
+    /// current Viterbi parse, along with the subtrees spanning only them. Only
+    /// the part of the parse not settled yet is expanded, so the cost does not
+    /// grow with the length of the input. Nothing is settled while the input
+    /// so far cannot be a complete sentence.
+    /// @returns The terminals settled and their largest subtrees. Unavailable
+    /// (always empty) if the parser keeps no Viterbi parse trees.
+    /// @remarks reset() starts settling from the beginning again.
+    SettledParse getSettledParse();
+
+    /// @brief Set the beam used to drop unlikely states at each parsing step.
+    ///
+    /// Pruning is lossy: the alpha values and the Viterbi parse only account
+    /// for the states that survive the beam. By default no state is pruned.
+    /// @param beam The thresholds and maximum number of states per step.
+    /// @remarks The beam applies from the next call to parse() onwards.
+    void setBeam(const Beam& beam);
+
+    /// @brief Get the beam currently used by this parser.
+    /// @returns The beam set with setBeam().
+    const Beam& getBeam() const;
+
+    /// @brief Get the number of states dropped by the beam.
+    /// @returns The number of states pruned since this parser was constructed
+    /// or last reset().
+    size_t getPrunedCount() const;
+
+    /// @brief Bound the memory used by long parses (e.g. continuous streams).
+    ///
+    /// In streaming mode the parser periodically discards the parsing steps
+    /// it can no longer go back to, and keeps only what the rest of the parse
+    /// (and, optionally, the Viterbi parse) needs from the others. Results
+    /// are the same as without streaming.
+    /// @param streaming True to enable streaming mode, false to disable it.
+    /// @param keepTrees If false, the Viterbi parse tree is not tracked at all
+    /// and getViterbiParse() only reports its probability (with no terminals
+    /// and an empty parse tree). Memory then stays flat over time, rather
+    /// than growing with the size of the tree. Parsers constructed without
+    /// trees never track them.
+    /// @remarks Changing this setting resets the parser (see reset()).
+    void setStreaming(bool streaming, bool keepTrees = true);
+
+    /// @brief Rescale the forward and inner probabilities at each step.
+    ///
+    /// Alpha and gamma values are products of probabilities, so on long
+    /// inputs they become denormal (which is very slow) and then underflow to
+    /// zero. In scaled-forward mode they are normalised at each step and the
+    /// normalisers kept in log space. Results (max alpha, predictions, the
+    /// Viterbi parse and its tree) are the same, except that they no longer
+    /// underflow. Debug output shows the scaled values.
+    /// @param scaling True to enable scaled-forward mode, false to disable it.
+    /// @remarks Changing this setting resets the parser (see reset()).
+    void setScaling(bool scaling);
+
+    /// @brief Set how many discarded parsing steps the parser keeps the
+    /// memory of.
+    ///
+    /// Parsing steps discarded by reset() (or by streaming mode) go to a
+    /// pool, with the memory of their states, and the next parsing steps are
+    /// built in them. Parsing many short inputs with the same parser then
+    /// allocates no memory for the steps once the pool has warmed up. Steps
+    /// discarded while the pool is full are freed.
+    /// @param limit Most parsing steps in the pool, 256 by default. Zero
+    /// frees every parsing step as soon as it is discarded.
+    /// @remarks Each step in the pool keeps the memory of its largest use,
+    /// so a small limit bounds the memory held after a long input.
+    void setPoolLimit(size_t limit);
+
+    /// @brief Get the most parsing steps kept for reuse.
+    /// @returns The limit set with setPoolLimit().
+    size_t getPoolLimit() const;
+
+    /// @brief Make an independent copy of this parser, e.g. to try several
+    /// continuations of the same input.
+    ///
+    /// The copy shares all the parsing steps so far with this parser rather
+    /// than copying them: parsing steps are never modified once parsed, and
+    /// a step is only copied when one of the parsers has to modify it (e.g.
+    /// in streaming mode). The copy has the same settings and results as
+    /// this parser, and it is parsed, reset or destroyed independently.
+    /// @returns The copy, owned by the caller.
+    /// @note A parser and its copies must be used from the same thread.
+    BasicSParser* fork() const;
+
     /// @brief Print debug information for all SParsers operations.
     /// @param debug The stream the information will be printed to.
     /// @remarks In *Python* this method does not take any arguments.
@@ -113,13 +289,22 @@ public:
 
 private:
     // Forbid copying
-    SParser(const SParser&);
-    SParser& operator=(const SParser& );
+    BasicSParser(const BasicSParser&);
+    BasicSParser& operator=(const BasicSParser& );
 
     class Impl;
     Impl* pimpl_;
+
+    explicit BasicSParser(Impl* pimpl);
 };
 
+/// @brief Parser computing all of its results (forward, inner and Viterbi).
+typedef BasicSParser<semiring::Full> SParser;
+/// @brief Parser computing only the Viterbi parse.
+typedef BasicSParser<semiring::Viterbi> ViterbiSParser;
+/// @brief Parser computing only forward and inner probabilities.
+typedef BasicSParser<semiring::Prefix> PrefixSParser;
+
 } //end of sartparser namespace
 
 #endif
@@ -58,6 +58,56 @@ bool ParseProbability::isValid() const
     return scaleLength > 0;
 }
 
+bool ParseProbability::operator==(const ParseProbability& other) const
+{
+    return ( raw == other.raw &&
+             scaled == other.scaled &&
+             scaleLength == other.scaleLength );
+}
+
+//==============================================================================
+// SETTLED PARSE CONSTRUCTORS
+//==============================================================================
+SettledParse::SettledParse()
+    : start(0)
+    , terminals()
+    , subtrees()
+    , probability()
+{
+}
+
+//==============================================================================
+// BATCH RESULT CONSTRUCTORS
+//==============================================================================
+BatchResult::BatchResult()
+    : status(OK)
+    , viterbiParse()
+    , maxAlpha()
+{
+}
+
+//==============================================================================
+// BEAM METHODS
+//==============================================================================
+Beam::Beam()
+    : threshold(0.0)
+    , relativeThreshold(0.0)
+    , maxStates(0)
+{
+}
+
+Beam::Beam(Real threshold, Real relativeThreshold, size_t maxStates)
+    : threshold(threshold)
+    , relativeThreshold(relativeThreshold)
+    , maxStates(maxStates)
+{
+}
+
+bool Beam::isEnabled() const
+{
+    return threshold > 0.0 || relativeThreshold > 0.0 || maxStates > 0;
+}
+
 //==============================================================================
 // PARSE TREE IMPL
 //==============================================================================
@@ -171,6 +221,57 @@ const std::vector<ParseTree>& ParseTree::children() const
 // PARSE TREE FROM STATE
 //==============================================================================
 ParseTree ParseTreeUtil::ParseTreeFromState(const SState& s)
+{
+    ParseTree::Impl* pimpl = NodeFromState(s);
+
+    for( size_t i = 0; i < s.GetChildCount(); ++i)
+    {
+        pimpl->children.push_back( ParseTreeFromState( *s.GetChild(i)) );
+    }
+
+    return ParseTree(pimpl);
+}
+
+ParseTree ParseTreeUtil::ParseTreeFromState(
+        const SState& s,
+        const std::vector<Real>& logScales,
+        size_t end)
+{
+    ParseTree::Impl* pimpl = NodeFromState(s);
+
+    // Back to unscaled values
+    Real alpha = s.GetAlpha();
+    pimpl->alpha = (alpha > 0.0) ?
+                std::exp( std::log(alpha) + logScales[end] ) : alpha;
+    pimpl->gamma = s.GetGamma() * std::exp( logScales[end] - logScales[s.GetK()] );
+
+    // Walking the right hand side backwards, a terminal takes one step and
+    // a nonterminal the span of its child, which gives where each child ends
+    std::vector<KTokenPtr> rhs;
+    for( KTokItem tok = s.GetFirst(); tok; tok = tok.GetNext() )
+        rhs.push_back( tok.GetToken() );
+
+    size_t pos = end;
+    size_t childIndex = s.GetChildCount();
+    pimpl->children.resize( childIndex );
+    for( size_t i = rhs.size(); i-- > 0 && childIndex > 0; )
+    {
+        if( rhs[i]->GetType() == Token::TERMINAL )
+        {
+            --pos;
+            continue;
+        }
+
+        --childIndex;
+        KSStatePtr pCh = s.GetChild(childIndex);
+        pimpl->children[childIndex] = ParseTreeFromState(*pCh, logScales, pos);
+        pos = pCh->GetK();
+    }
+
+    return ParseTree(pimpl);
+}
+
+ParseTree::Impl* ParseTreeUtil::NodeFromState(const SState& s)
 {
     ParseTree::Impl* pimpl = new ParseTree::Impl();
 
@@ -189,12 +290,7 @@ ParseTree ParseTreeUtil::ParseTreeFromState(const SState& s)
         tok = tok.GetNext();
     }
 
-    for( size_t i = 0; i < s.GetChildCount(); ++i)
-    {
-        pimpl->children.push_back( ParseTreeFromState( *s.GetChild(i)) );
-    }
-
-    return ParseTree(pimpl);
+    return pimpl;
 }
 
 //==============================================================================
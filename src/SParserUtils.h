@@ -61,6 +61,10 @@ struct ParseProbability
     /// @brief Check the fields make sense
     /// @return True if probabilities between 0-1 and scaledLength > 1.
     bool isValid() const;
+
+    /// @brief Compare two probabilities.
+    /// @return True if all the fields of both are the same.
+    bool operator==(const ParseProbability& other) const;
 };
 
 /// @brief Class to contain the tree that yields the viterbi parse.
@@ -150,6 +154,81 @@ struct ViterbiParse
             const ParseTree& parseTree);
 };
 
+/// @brief Struct to contain the part of the Viterbi Parse settled by fixed-lag
+/// decoding.
+///
+/// Terminals are settled once they are further than the lag behind the last
+/// parsing step. They are taken from the Viterbi parse at that time and never
+/// revised, so consecutive settled parts need not come from the same parse.
+/// @see sartparser::SParser::getSettledParse().
+/// @remarks In *Python*, this class cannot be instantiated and its members are
+/// read-only.
+struct SettledParse
+{
+    /// @brief Position in the input of the first terminal in terminals.
+    size_t start;
+    /// @brief The ordered set of terminals settled.
+    StringVector terminals;
+    /// @brief The largest subtrees of the parse spanning only the terminals
+    /// settled, in order.
+    std::vector<ParseTree> subtrees;
+    /// @brief The probability of the Viterbi parse the terminals were taken
+    /// from.
+    ParseProbability probability;
+
+    /// @brief Default constructor.
+    SettledParse();
+};
+
+/// @brief Struct to contain the results of parsing one sequence of a batch.
+/// @see sartparser::SParser::parseBatch().
+/// @remarks This struct is **not** available in *Python*.
+struct BatchResult
+{
+    /// @brief sartparser::OK if all the steps of the sequence were parsed,
+    /// the error of the first step that failed otherwise (the other results
+    /// are then those of the steps before it).
+    Status status;
+    /// @brief The Viterbi parse of the sequence (see
+    /// sartparser::SParser::getViterbiParse()).
+    ViterbiParse viterbiParse;
+    /// @brief The maximum alpha after the last step of the sequence (see
+    /// sartparser::SParser::getCurrentMaxAlpha()).
+    ParseProbability maxAlpha;
+
+    /// @brief Default constructor.
+    BatchResult();
+};
+
+/// @brief Beam used by SParser to drop unlikely states at each step.
+///
+/// States are compared by their alpha (forward) probability. A threshold set
+/// to 0 disables that criterion, so a default constructed Beam keeps every
+/// state.
+/// @see sartparser::SParser::setBeam().
+struct Beam
+{
+    /// @brief Drop states whose alpha is below this value.
+    Real threshold;
+    /// @brief Drop states whose alpha is below this fraction (0-1) of the
+    /// highest alpha in the same step.
+    Real relativeThreshold;
+    /// @brief Keep at most this many states per step (0 means no limit).
+    size_t maxStates;
+
+    /// @brief Default constructor. Disable all pruning.
+    Beam();
+    /// @brief Constructor
+    /// @param threshold absolute alpha threshold
+    /// @param relativeThreshold alpha threshold relative to the best state
+    /// @param maxStates maximum number of states per step
+    Beam(Real threshold, Real relativeThreshold, size_t maxStates);
+
+    /// @brief Check if this beam drops any state at all.
+    /// @return True if any of the criteria is enabled.
+    bool isEnabled() const;
+};
+
 /// @brief Class to contain predictions about next parsing step.
 /// @see sartparser::SParser::getPrediction().
 /// @remarks In *Python*, this class cannot be instantiated and its members are
@@ -163,8 +242,8 @@ struct Prediction
     /// step.
     ProbabilityDistribution terminalDistribution;
 
-    /// @brief Contains max alpha values for parser, should terminalDistribution
-    /// be used as input for the next step.
+    /// @brief Contains max alpha values of the states scanning a terminal,
+    /// should terminalDistribution be used as input for the next step.
     ParseProbability probability;
 };
 
@@ -36,6 +36,18 @@ namespace impl
 struct ParseTreeUtil
 {
     static ParseTree ParseTreeFromState(const SState & );
+
+    // Same for a parse in scaled-forward mode (see SCell::SetScaling()),
+    // logScales holds the log scale of every cell and end is the index of
+    // the cell s is in
+    static ParseTree ParseTreeFromState(
+            const SState& s,
+            const std::vector<Real>& logScales,
+            size_t end);
+
+private:
+    // Node for s without its children
+    static ParseTree::Impl* NodeFromState(const SState& s);
 };
 
 } // end of impl namespace
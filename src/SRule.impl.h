@@ -31,8 +31,6 @@
 #include "Common.h"
 #include "Token.impl.h"
 
-#include <algorithm>
-
 
 namespace sartparser
 {
@@ -53,10 +51,9 @@ public:
     SRule& operator=(const SRule&);
 
     void AddToken(const Token&);
-    void AddTokenChain(const TokItem&);
-    Status AddBeforeVar(const Token &);
 
     void SetProb(Real);
+    void SetLHS(KTokenPtr);
 
     TokItem GetFirst();
     TokItem GetLast();
@@ -65,14 +62,16 @@ public:
     KTokItem GetLast() const;
     KTokItem Get(size_t pos) const;
     Real GetProb() const;
+    KTokenPtr GetLHS() const;
+    size_t GetCount() const;
     bool SameTokens(const SRule&) const;
     bool IsUnit() const;
 
 private:
     Storage data_;
     Real prob_;
-
-    static bool isVar(const Token &);
+    // Owned by the grammar (production this rule belongs to)
+    KTokenPtr lhs_;
 };
 
 class TokItem
@@ -118,6 +117,7 @@ private:
 inline SRule::SRule()
     :data_()
     ,prob_(0.0)
+    ,lhs_(NULL)
 {
 }
 
@@ -128,6 +128,7 @@ inline SRule::~SRule()
 inline SRule::SRule(const SRule& r)
     : data_(r.data_)
     , prob_(r.prob_)
+    , lhs_(r.lhs_)
 {
 }
 
@@ -143,6 +144,8 @@ inline SRule& SRule::operator=(const SRule& r)
     //Copy probability
     prob_ = r.prob_;
 
+    lhs_ = r.lhs_;
+
     return *this;
 }
 
@@ -151,41 +154,14 @@ inline void SRule::AddToken(const Token &t)
     data_.push_back(t);
 }
 
-inline void SRule::AddTokenChain(const TokItem& chain)
-{
-    for(TokItem ti = chain; ti.isValid(); ti = ti.GetNext() )
-    {
-        data_.push_back( *ti.GetToken() );
-    }
-}
-
-inline Status SRule::AddBeforeVar(const Token& t)
+inline void SRule::SetProb(Real p)
 {
-    if (data_.empty() )
-    {
-        std::cerr << "ERROR: Variable state has an empty rule." << std::endl;
-        return ERR_INVPARAM;
-    }
-
-    //Try to find var
-    Iterator it;
-    it = std::find_if( data_.begin(), data_.end(), SRule::isVar );
-
-    if (it == data_.end() )
-    {
-        std::cerr << "ERROR: '?' not found in variable state." << std::endl;
-        return ERR_INVPARAM;
-    }
-
-    //Insert at position (other elements get shifted)
-    data_.insert(it, t);
-
-    return OK;
+    prob_ = p;
 }
 
-inline void SRule::SetProb(Real p)
+inline void SRule::SetLHS(KTokenPtr pT)
 {
-    prob_ = p;
+    lhs_ = pT;
 }
 
 inline TokItem SRule::GetFirst()
@@ -223,6 +199,16 @@ inline Real SRule::GetProb() const
     return prob_;
 }
 
+inline KTokenPtr SRule::GetLHS() const
+{
+    return lhs_;
+}
+
+inline size_t SRule::GetCount() const
+{
+    return data_.size();
+}
+
 inline bool SRule::SameTokens(const SRule& r) const
 {
     if (data_.size() != r.data_.size())
@@ -247,11 +233,6 @@ inline bool SRule::IsUnit() const
     return ( data_.size() == 1 && data_.at(0).GetType() == Token::NONTERMINAL );
 }
 
-inline bool SRule::isVar(const Token &t)
-{
-    return t.GetName() == "?";
-}
-
 inline TokItem::TokItem()
     : pos_(0)
     , container_(NULL)
@@ -26,115 +26,138 @@
  */
 
 #include "SState.impl.h"
+#include "HashMap.impl.h"
 
 
 using namespace sartparser;
 using namespace impl;
 
 SState::SState()
-    : rule_()
-    , lhs_()
+    : rule_(NULL)
+    , Children(NULL)
+    , nextInBucket_(NULL)
+    , nextWaiting_(NULL)
     , k_(0)
     , dot_(0)
-    , finished_(false)
     , label_(UNKNOWN)
-    , P (1.0)
     , Alpha(1.0)
-    , Beta(1.0)
     , Gamma(1.0)
     , V (1.0)
     , pLowMark(0.0)
     , pHiMark(0.0)
-    , Children(Array<SState>::NO_DELETE)
 {
 }
 
 
 SState::SState(const SState& rS)
     : rule_( rS.rule_ )
-    , lhs_( rS.lhs_ )
+    , Children( rS.Children )
+    , nextInBucket_(NULL)
+    , nextWaiting_(NULL)
     , k_ ( rS.k_ )
     , dot_( rS.dot_ )
-    , finished_( rS.finished_ )
     , label_ (rS.label_)
-    , P (rS.P)
     , Alpha(rS.Alpha)
-    , Beta(rS.Beta)
     , Gamma(rS.Gamma)
     , V (rS.V)
     , pLowMark(rS.pLowMark)
     , pHiMark(rS.pHiMark)
-    , Children(Array<SState>::NO_DELETE)
 {
 }
 
 
-SState& SState::operator=(SState& rS)
+SState& SState::operator=(const SState& rS)
 {
     if ( this == &rS)
         return *this;
 
     rule_ = rS.rule_;
-    lhs_ = rS.lhs_;
+    Children = rS.Children;
     k_ = rS.k_;
     dot_ = rS.dot_;
     label_ = rS.label_;
-    P       = rS.P;
     Alpha   = rS.Alpha;
-    Beta    = rS.Beta;
     Gamma   = rS.Gamma;
     V       = rS.V;
     pLowMark = rS.pLowMark;
     pHiMark  = rS.pHiMark;
 
-    RemoveChildren();
+    return *this;
+}
 
-    for(size_t i = 0; i < rS.GetChildCount(); i++)
-        Children.Add(rS.GetChild(i));
+KTokItem SState::GetFirst() const
+{
+    return (rule_) ? rule_->GetFirst() : KTokItem();
+}
 
-    return *this;
+KTokItem SState::GetAfterDot() const
+{
+    return (rule_) ? rule_->Get(dot_) : KTokItem();
 }
 
-void SState::RemoveChildren()
+size_t SState::GetHash() const
 {
-   for(int i = Children.GetCount() - 1; i >= 0; --i)
-      Children.Remove(static_cast<size_t>(i));
+    Hash<size_t> hasher;
+    size_t h = HashCombine(k_, dot_);
+    return HashCombine(h, hasher( reinterpret_cast<size_t>(rule_) ) );
 }
 
-Status SState::CheckDot()
+SStatePtr SState::FindChild(size_t i) const
 {
-   // Check if at the end of rule
-   TokItem pTI = rule_.GetFirst();
-   size_t count = 0;
-   while(pTI)
-   {
-      pTI = pTI.GetNext();
-      count++;
-   }
+    if ( i >= GetChildCount() )
+        return NULL;
 
-   if(dot_ > count)
-   {
-      std::cerr << "ERROR: Dot advanced beyond boundary in "
-                << lhs_.GetName() << std::endl;
-      return ERR_OUTOFBOUNDS;
-   }
+    // The list starts from the last child
+    const SChildLink* link = Children;
+    for(size_t j = link->count - 1; j > i; --j)
+        link = link->prev;
 
-   finished_ = (count == dot_);
-   return OK;
+    return link->state;
 }
 
-Status SState::ReplaceAfterDot(const Token& pT)
+Status SState::AddChild(SStatePtr pS, SChildPool& pool)
 {
-   TokItem pTI = rule_.Get(dot_);
+    SChildLink* link = pool.New();
+    link->state = pS;
+    link->prev = Children;
+    link->count = GetChildCount() + 1;
+    Children = link;
+    return OK;
+}
 
-   if (!pTI)
-   {
-       return ERR_NOTFOUND;
-   }
-   else
+Status SState::ReplaceChild(size_t i, SStatePtr pS, SChildPool& pool)
+{
+    size_t count = GetChildCount();
+    if ( i >= count )
+        return ERR_OUTOFBOUNDS;
+
+    // Links are shared with other states, so the part of the list from the
+    // last child down to the i-th one has to be copied
+    std::vector<SStatePtr> after;
+    const SChildLink* link = Children;
+    for(size_t j = count - 1; j > i; --j)
+    {
+        after.push_back(link->state);
+        link = link->prev;
+    }
+
+    Children = link->prev;
+    AddChild(pS, pool);
+    for(size_t j = after.size(); j > 0; --j)
+        AddChild(after[j - 1], pool);
+
+    return OK;
+}
+
+Status SState::CheckDot()
+{
+   // Check if at the end of rule
+   if(dot_ > rule_->GetCount())
    {
-       pTI.SetToken(pT);
-       return OK;
+      std::cerr << "ERROR: Dot advanced beyond boundary in "
+                << GetLHS()->GetName() << std::endl;
+      return ERR_OUTOFBOUNDS;
    }
-}
 
+   return OK;
+}
@@ -29,7 +29,7 @@
 #define __SSTATE_HPP
 
 #include "Common.h"
-#include "Array.impl.h"
+#include "Arena.impl.h"
 #include "SRule.impl.h"
 
 namespace sartparser
@@ -37,6 +37,19 @@ namespace sartparser
 namespace impl
 {
 
+// Children of a state are kept as an immutable list (last child first), so
+// states derived from each other share their common children.
+struct SChildLink
+{
+    SStatePtr state;
+    const SChildLink* prev;
+    size_t count;
+};
+
+typedef Arena<SChildLink> SChildPool;
+
+// A dotted rule. The rule itself belongs to the grammar, a state only keeps
+// a pointer to it, so states are small and cheap to copy.
 class SState
 {
 public:
@@ -45,30 +58,29 @@ public:
     SState();
     SState(const SState& rS);
 
-    SState& operator=(SState& rS);
+    SState& operator=(const SState& rS);
 
     //Getters
-    KTokItem   GetFirst()           const { return rule_.GetFirst(); }
+    KTokItem   GetFirst()           const;
     Label      GetLabel()           const { return label_; }
     size_t     GetK()               const { return k_; }
     size_t     GetDot()             const { return dot_; }
-    KTokenPtr  GetLHS()             const { return &lhs_; }
-    TokItem    GetAfterDot()              { return rule_.Get(dot_); }
-    KTokItem   GetAfterDot()        const { return rule_.Get(dot_); }
-    Real       GetProb()            const { return P;    }
+    KSRulePtr  GetRule()            const { return rule_; }
+    KTokenPtr  GetLHS()             const { return rule_->GetLHS(); }
+    KTokItem   GetAfterDot()        const;
+    Real       GetProb()            const { return rule_->GetProb(); }
     Real       GetAlpha()           const { return Alpha; }
-    Real       GetBeta()            const { return Beta;  }
     Real       GetGamma( )          const { return Gamma; }
     Real       GetV()               const { return V;     }
     Real       GetLowMark()         const { return pLowMark; }
     Real       GetHiMark()          const { return pHiMark ; }
-    size_t     GetChildCount()      const { return Children.GetCount(); }
-    SStatePtr  GetChild( size_t i )       { return Children.Get(i); }
-    KSStatePtr GetChild( size_t i ) const { return Children.Get(i); }
+    size_t     GetChildCount()      const { return Children ? Children->count : 0; }
+    SStatePtr  GetChild( size_t i )       { return FindChild(i); }
+    KSStatePtr GetChild( size_t i ) const { return FindChild(i); }
 
     // Is? methods
-    bool IsUnit()      const { return rule_.IsUnit(); }
-    bool IsFinished()  const { return finished_; }
+    bool IsUnit()      const { return rule_->IsUnit(); }
+    bool IsFinished()  const { return dot_ == rule_->GetCount(); }
     bool IsCompleted() const { return label_ == COMPLETED; }
     bool IsScanned()   const { return label_ == SCANNED; }
     bool IsPredicted() const { return label_ == PREDICTED; }
@@ -76,32 +88,24 @@ public:
 
     // Setters
     void   SetLabel(Label label)      { label_ = label; }
-    void   SetRule( const SRule& r )   { rule_ = r; }
-    void   SetLHS( const Token& tok ) { lhs_ = tok; }
+    void   SetRule( KSRulePtr pR )    { rule_ = pR; }
     void   SetK( size_t AK )          { k_ = AK; }
     Status SetDot( size_t ADot )      { dot_ = ADot; return CheckDot(); }
-    void   SetProb( Real AP )         { P = AP; }
     void   SetAlpha( Real AnAlpha )   { Alpha = AnAlpha; }
-    void   SetBeta( Real ABeta )      { Beta  = ABeta; }
     void   SetGamma( Real AGamma )    { Gamma = AGamma; }
     void   SetV( Real AV )            { V = AV;}
     void   SetLowMark( Real AMark )   { pLowMark = AMark; }
     void   SetHiMark( Real AMark  )   { pHiMark = AMark; }
 
-    //RHS related functions
-    void   AddToken( const Token& t )   { rule_.AddToken(t); }
-    Status AddBeforeVar(const Token& t) { return rule_.AddBeforeVar(t); }
-
     //Dot related functions
     Status AdvanceDot() { dot_++; return CheckDot(); }
     Status CheckDot();
-    Status ReplaceAfterDot(const Token &pT);
 
-    //Children related functions
-    Status    AddChild  (SStatePtr pS)           {return Children.Add(pS);}
-    Status    AddChildAt(size_t i, SStatePtr pS) {return Children.AddAt(i, pS);}
-    SStatePtr RemoveChild (size_t i)             {return Children.Remove(i);}
-    void      RemoveChildren();
+    //Children related functions (new links are taken from pool)
+    Status AddChild(SStatePtr pS, SChildPool& pool);
+    Status ReplaceChild(size_t i, SStatePtr pS, SChildPool& pool);
+    void   CopyChildren(const SState& rS) { Children = rS.Children; }
+    void   RemoveChildren()               { Children = NULL; }
 
     //Comparison method
     bool sameKDotAndProd(const SState& rS) const
@@ -109,27 +113,40 @@ public:
         return (
             k_ == rS.k_ &&
             dot_ == rS.dot_ &&
-            lhs_.SameName(rS.lhs_) &&
-            rule_.SameTokens(rS.rule_) );
+            rule_ == rS.rule_ );
     }
 
+    //Hash consistent with sameKDotAndProd()
+    size_t GetHash() const;
+
+    //Chaining of states with the same hash (used by SCell's index)
+    SStatePtr GetNextInBucket() const      { return nextInBucket_; }
+    void      SetNextInBucket(SStatePtr pS) { nextInBucket_ = pS; }
+
+    //Chaining of states waiting on the same symbol (used by SCell's index)
+    SStatePtr GetNextWaiting() const       { return nextWaiting_; }
+    void      SetNextWaiting(SStatePtr pS)  { nextWaiting_ = pS; }
+
 private:
-    SRule rule_;
-    Token lhs_;
+    SStatePtr FindChild(size_t i) const;
+
+    KSRulePtr rule_;
+    const SChildLink* Children;
+
+    // Not copied, they belong to the cell the state is in
+    SStatePtr nextInBucket_;
+    SStatePtr nextWaiting_;
+
     size_t k_;
     size_t dot_;
-    bool finished_;
     Label label_;
-    Real P;
+
     Real Alpha;
-    Real Beta;
     Real Gamma;
     Real V;
 
     Real pLowMark;
     Real pHiMark;
-
-    Array<SState> Children;
 };
 
 
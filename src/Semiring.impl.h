@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2014 Miguel Sarabia
+ * Imperial College London
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef SEMIRING_IMPL_H
+#define SEMIRING_IMPL_H
+
+#include "Common.h"
+
+namespace sartparser
+{
+namespace impl
+{
+
+// What the Earley engine computes for each semiring the parser can be
+// instantiated with (see BasicSParser). Flags are compile time constants, so
+// the code for the quantities a semiring does not need is optimised away.
+//  - FORWARD: alpha and gamma, by sum-product
+//  - VITERBI: V, by max-plus in log space, and the children of completed
+//    states (the backpointers of the Viterbi parse)
+// INDEX numbers the semirings from 0 to SEMIRING_COUNT - 1, for the data kept
+// per semiring (see CompiledGrammar).
+const static size_t SEMIRING_COUNT = 3;
+
+template<typename Semiring>
+struct SemiringTraits;
+
+template<>
+struct SemiringTraits<semiring::Full>
+{
+    static const bool FORWARD = true;
+    static const bool VITERBI = true;
+    static const size_t INDEX = 0;
+};
+
+template<>
+struct SemiringTraits<semiring::Viterbi>
+{
+    static const bool FORWARD = false;
+    static const bool VITERBI = true;
+    static const size_t INDEX = 1;
+};
+
+template<>
+struct SemiringTraits<semiring::Prefix>
+{
+    static const bool FORWARD = true;
+    static const bool VITERBI = false;
+    static const size_t INDEX = 2;
+};
+
+}// end of impl namespace
+}// end of sartparser namespace
+
+#endif // SEMIRING_IMPL_H
@@ -33,6 +33,7 @@
 #include "PTerminal.h"
 #include "SParserUtils.h"
 #include "CFGrammar.impl.h"
+#include "GrammarImage.impl.h"
 
 using namespace sartparser;
 using namespace impl;
@@ -283,6 +284,13 @@ struct Stream
     }
 
 
+    static Status saveGrammarImage(
+            std::ostream& o,
+            const CompiledGrammar& grammar)
+    {
+        return GrammarImage::Write(o, grammar.grammar_.pimpl_->sg);
+    }
+
     static void dumpGrammar( std::ostream& o, const CFGrammar& cfg )
     {
         SGrammar& g = cfg.pimpl_->sg;
@@ -353,9 +361,6 @@ struct Stream
     {
         size_t n = sg.GetNCount();
 
-        if( sg.GetPartial() )
-            --n;
-
         o << "         ";
         for(size_t i = 0; i < n; i++)
             o << std::setw(9) << sg.GetNByIndex(i)->GetName();
@@ -523,6 +528,11 @@ Status loadGrammar(std::istream &i, CFGrammar &cfg)
     return Stream::loadGrammar(i, cfg);
 }
 
+Status saveGrammarImage(std::ostream& o, const CompiledGrammar& grammar)
+{
+    return Stream::saveGrammarImage(o, grammar);
+}
+
 
 void dumpGrammarMatrices(std::ostream &o, const CFGrammar& cfg)
 {
@@ -589,6 +599,20 @@ std::ostream& operator<<(std::ostream &o, const ViterbiParse &v)
     return o;
 }
 
+std::ostream& operator<<(std::ostream &o, const SettledParse &s)
+{
+    o << "Settled from " << s.start << ": ";
+
+    typedef StringVector::const_iterator Iterator;
+    for (Iterator it = s.terminals.begin(); it!= s.terminals.end(); ++it)
+    {
+        o << *it << " ";
+    }
+
+    o << "    " << s.probability;
+    return o;
+}
+
 std::ostream& operator<<(std::ostream &o, const Prediction &p)
 {
     o << "Prediction: " << std::setprecision(4);
@@ -45,6 +45,17 @@ namespace sartparser
 /// CFGrammar.load() instead.
 Status loadGrammar(std::istream& i, CFGrammar& cfg);
 
+/// @brief Write a compiled grammar as a binary grammar image, which
+/// CompiledGrammar can load much faster than compiling the grammar again.
+/// @param o The output stream, it should be opened in binary mode.
+/// @param grammar The grammar to write.
+/// @returns sartparser::OK if everything went well, sartparser::ERR_INVPARAM
+/// if the stream could not be written.
+/// @remarks The image can only be loaded by the same version of the library,
+/// on the same kind of machine (byte order and size of sartparser::Real).
+/// In *Python*, use CompiledGrammar.saveImage() instead.
+Status saveGrammarImage(std::ostream& o, const CompiledGrammar& grammar);
+
 /// @brief Load a set of concurrent terminals and their probabilities from
 /// a stream.
 /// @param i The input stream.
@@ -120,6 +131,10 @@ std::ostream& operator<<(std::ostream& o, const ParseTree& t);
 /// @remarks In *Python*, this overload is available through the str() function.
 std::ostream& operator<<(std::ostream& o, const ViterbiParse& v);
 
+/// @brief Stream-insertion operator for SettledParse.
+/// @remarks In *Python*, this overload is available through the str() function.
+std::ostream& operator<<(std::ostream& o, const SettledParse& s);
+
 /// @brief Stream-insertion operator for Prediction.
 /// @remarks In *Python*, this overload is available through the str() function.
 std::ostream& operator<<(std::ostream& o, const Prediction& p);
@@ -54,12 +54,14 @@ public:
 
 
     const std::string& GetName() const;
+    int GetId() const;
     Type GetType () const;
     Real GetProb() const;
     Real GetHigh() const;
     Real GetLow () const;
 
     void SetName(const std::string& name);
+    void SetId(int id);
     void SetType (Type type );
     void SetProb(Real prob);
     void SetHigh(Real high);
@@ -77,6 +79,8 @@ public:
 
 private:
     std::string name_;
+    // Index of the symbol in its grammar (-1 if not interned)
+    int id_;
     Type type_;
     Real prob_;
     Real high_;
@@ -90,6 +94,7 @@ inline Token::Token(const std::string& name,
                     Real high,
                     Real low)
     : name_(name)
+    , id_(-1)
     , type_(type)
     , prob_(prob)
     , high_(high)
@@ -99,6 +104,7 @@ inline Token::Token(const std::string& name,
 
 inline Token::Token(const Token& t)
     : name_(t.name_)
+    , id_(t.id_)
     , type_(t.type_)
     , prob_(t.prob_)
     , high_(t.high_)
@@ -111,6 +117,7 @@ inline Token& Token::operator=(const Token& t)
     if (this != &t)
     {
         name_ = t.name_;
+        id_ = t.id_;
         type_ = t.type_;
         prob_ = t.prob_;
         high_ = t.high_;
@@ -129,6 +136,11 @@ inline const std::string& Token::GetName() const
     return name_;
 }
 
+inline int Token::GetId() const
+{
+    return id_;
+}
+
 inline Token::Type Token::GetType () const
 {
     return type_;
@@ -154,6 +166,11 @@ inline void Token::SetName(const std::string& name)
     name_ = name;
 }
 
+inline void Token::SetId(int id)
+{
+    id_ = id;
+}
+
 inline void Token::SetType(Type type )
 {
     type_  = type;
@@ -192,12 +209,16 @@ inline void Token::SetData(
 
 inline bool Token::SameName(const Token& t) const
 {
+    // Symbols interned by the same grammar are compared by their id only
+    if ( id_ >= 0 && t.id_ >= 0 )
+        return id_ == t.id_ && type_ == t.type_;
+
     return name_ == t.name_;
 }
 
 inline TokenPtr Token::Clone() const
 {
-    return new Token(name_, type_, prob_, high_, low_);
+    return new Token(*this);
 }
 
 
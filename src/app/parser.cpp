@@ -87,6 +87,8 @@ public:
     bool predict() const;
     bool useCL() const;
     bool benchmark() const;
+    bool viterbi() const;
+    bool prefix() const;
 
     const static std::string help;
 
@@ -104,6 +106,8 @@ private:
     bool predict_;
     bool useCL_;
     bool benchmark_;
+    bool viterbi_;
+    bool prefix_;
 
     void deletePtrs();
 };
@@ -119,6 +123,8 @@ Options::Options()
     , predict_(false)
     , useCL_(false)
     , benchmark_(false)
+    , viterbi_(false)
+    , prefix_(false)
 {
 }
 
@@ -165,6 +171,14 @@ void Options::init(int argc, char **argv)
                                 "Benchmarking support was not built");
                 }
             }
+            else if (arg == "--viterbi")
+            {
+                viterbi_ = true;
+            }
+            else if (arg == "--prefix")
+            {
+                prefix_ = true;
+            }
             else
             {
                 throw std::runtime_error("Unknown option: " + arg);
@@ -209,6 +223,13 @@ void Options::init(int argc, char **argv)
         deletePtrs();
         throw std::runtime_error("Required grammar file not specified");
     }
+
+    if ( (viterbi_ && prefix_) || ((viterbi_ || prefix_) && useCL_) )
+    {
+        deletePtrs();
+        throw std::runtime_error(
+                    "Only one of --viterbi, --prefix and --cl can be used");
+    }
 }
 
 
@@ -249,6 +270,16 @@ bool Options::benchmark() const
     return benchmark_;
 }
 
+bool Options::viterbi() const
+{
+    return viterbi_;
+}
+
+bool Options::prefix() const
+{
+    return prefix_;
+}
+
 void Options::deletePtrs()
 {
     delete grammarStream_;
@@ -258,7 +289,7 @@ void Options::deletePtrs()
 
 const std::string Options::help =
         "Usage: grammar_file [data_file] [output_file]"
-        "[--debug] [--predict] [--cl] [--benchmark] \n"
+        "[--debug] [--predict] [--cl] [--benchmark] [--viterbi] [--prefix]\n"
         "\nOptions:\n"
         "\tgrammar_file   Input grammar file\n"
         "\t[data_file]    Input sequence data"
@@ -268,7 +299,10 @@ const std::string Options::help =
         "\t[--debug]      Print parsing debug information\n"
         "\t[--predict]    Print intermidiate predictions\n"
         "\t[--cl]         Use OpenCL accelerated parser\n"
-        "\t[--benchmark]  Measure total parsing time\n";
+        "\t[--benchmark]  Measure total parsing time\n"
+        "\t[--viterbi]    Compute the Viterbi parse only\n"
+        "\t[--prefix]     Compute prefix probabilities only"
+        "(no Viterbi parse)\n";
 
 
 template<typename T>
@@ -401,18 +435,29 @@ int main(int argc, char **argv)
     }
 
     //Do actual parsing
-#ifdef USE_CLPARSER
-    if ( options.useCL() )
+    if ( options.viterbi() )
     {
-        retCode = parse<CLParser>(grammar, options);
+        retCode = parse<ViterbiSParser>(grammar, options);
     }
-    else
+    else if ( options.prefix() )
     {
-        retCode = parse<SParser>(grammar, options);
+        retCode = parse<PrefixSParser>(grammar, options);
     }
+    else
+    {
+#ifdef USE_CLPARSER
+        if ( options.useCL() )
+        {
+            retCode = parse<CLParser>(grammar, options);
+        }
+        else
+        {
+            retCode = parse<SParser>(grammar, options);
+        }
 #else
-    retCode = parse<SParser>(grammar, options);
+        retCode = parse<SParser>(grammar, options);
 #endif
+    }
 
     if( retCode != OK )
     {
@@ -27,6 +27,7 @@
 #include <boost/python/suite/indexing/vector_indexing_suite.hpp>
 
 #include <iomanip>
+#include <fstream>
 
 #include "../All.h"
 
@@ -79,6 +80,14 @@ Status parseWrapper( SParser& parser, const py::object& input)
     return parser.parse(input2);
 }
 
+Status saveImageWrapper(const CompiledGrammar& grammar, const std::string& path)
+{
+    std::ofstream file(path.c_str(), std::ios::out | std::ios::binary);
+    if ( !file.is_open() )
+        return ERR_INVPARAM;
+    return saveGrammarImage(file, grammar);
+}
+
 void setDebugWrapper(SParser& parser)
 {
     parser.setDebug(std::cout);
@@ -99,6 +108,9 @@ py::dict distribution2Dict(const Prediction& p)
 }
 
 
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(
+        setStreamingOverloads, SParser::setStreaming, 1, 2)
+
 //==============================================================================
 // MODULE DEFINITION
 //==============================================================================
@@ -127,6 +139,9 @@ BOOST_PYTHON_MODULE(pysartparser)
     py::class_<Rules>("Rules", py::no_init)
             .def(py::vector_indexing_suite<Rules>());
 
+    py::class_<ParseProbabilities>("ParseProbabilities", py::no_init)
+            .def(py::vector_indexing_suite<ParseProbabilities>());
+
     py::class_<PTerminal>("PTerminal")
             .def( py::init<std::string, Real, py::optional<Real, Real> >() )
             .def_readwrite("terminal", &PTerminal::terminal)
@@ -167,11 +182,25 @@ BOOST_PYTHON_MODULE(pysartparser)
             .def_readonly("parseTree", &ViterbiParse::parseTree)
             .def( "__str__", &toString<ViterbiParse> );
 
+    py::class_<SettledParse>("SettledParse", py::no_init)
+            .def_readonly("start", &SettledParse::start)
+            .def_readonly("terminals", &SettledParse::terminals)
+            .def_readonly("subtrees", &SettledParse::subtrees)
+            .def_readonly("probability", &SettledParse::probability)
+            .def( "__str__", &toString<SettledParse> );
+
     py::class_<Prediction>("Prediction", py::no_init)
             .add_property( "terminalDistribution", &distribution2Dict)
             .def_readonly( "probability", &Prediction::probability)
             .def("__str__", &toString<Prediction> );
 
+    py::class_<Beam>("Beam")
+            .def( py::init<Real, Real, size_t>() )
+            .def_readwrite("threshold", &Beam::threshold)
+            .def_readwrite("relativeThreshold", &Beam::relativeThreshold)
+            .def_readwrite("maxStates", &Beam::maxStates)
+            .def("isEnabled", &Beam::isEnabled);
+
     py::class_<Rule>("Rule", py::no_init)
             .def_readonly("lhs", &Rule::lhs)
             .def_readonly("rhs", &Rule::rhs)
@@ -194,16 +223,42 @@ BOOST_PYTHON_MODULE(pysartparser)
             .def("getRules", &CFGrammar::getRules)
             .def("__str__", &toString<CFGrammar> );
 
-    //Link lifetimes of CFGrammar and SParser
+    py::class_<CompiledGrammar, boost::noncopyable>
+            ("CompiledGrammar", py::init<const CFGrammar&>() )
+            .def(py::init<std::string>() )
+            .def("getGrammar", &CompiledGrammar::getGrammar, ReturnPolicy() )
+            .def("saveImage", &saveImageWrapper );
+
+    //Link lifetimes of CFGrammar (or CompiledGrammar) and SParser
     typedef py::with_custodian_and_ward<1,2> ConstructorPolicy;
 
+    //Forks keep the parser they come from (and so its grammar) alive
+    typedef py::return_value_policy<py::manage_new_object,
+            py::with_custodian_and_ward_postcall<0,1> > ForkPolicy;
+
     py::class_<SParser, boost::noncopyable>
-            ("SParser", py::init<CFGrammar&>()[ConstructorPolicy()])
+            ("SParser", py::init<CFGrammar&, py::optional<bool> >()
+                                                    [ConstructorPolicy()])
+            .def(py::init<const CompiledGrammar&, py::optional<bool> >()
+                                                    [ConstructorPolicy()])
             .def("__parse", parseWrapper )
             .def("reset", &SParser::reset)
             .def("getCurrentMaxAlpha", &SParser::getCurrentMaxAlpha)
             .def("getPrediction", &SParser::getPrediction)
+            .def("getPrefixProbabilities", &SParser::getPrefixProbabilities)
             .def("getViterbiParse", &SParser::getViterbiParse)
+            .def("setLag", &SParser::setLag )
+            .def("getLag", &SParser::getLag )
+            .def("getSettledParse", &SParser::getSettledParse )
+            .def("setBeam", &SParser::setBeam )
+            .def("getBeam", &SParser::getBeam, CopyReturnPolicy() )
+            .def("getPrunedCount", &SParser::getPrunedCount )
+            .def("setStreaming", &SParser::setStreaming,
+                 setStreamingOverloads() )
+            .def("setScaling", &SParser::setScaling )
+            .def("setPoolLimit", &SParser::setPoolLimit )
+            .def("getPoolLimit", &SParser::getPoolLimit )
+            .def("fork", &SParser::fork, ForkPolicy() )
             .def("setDebug", setDebugWrapper )
             .def("unsetDebug", &SParser::unsetDebug )
             .def("getGrammar", &SParser::getGrammar, ReturnPolicy() );